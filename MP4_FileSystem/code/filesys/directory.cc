@@ -1,19 +1,26 @@
 // directory.cc 
 //	Routines to manage a directory of file names.
 //
-//	The directory is a table of fixed length entries; each
+//	The directory is a hash table of fixed length entries; each
 //	entry represents a single file, and contains the file name,
 //	and the location of the file header on disk.  The fixed size
 //	of each directory entry means that we have the restriction
 //	of a fixed maximum size for file names.
 //
-//	The constructor initializes an empty directory of a certain size;
-//	we use ReadFrom/WriteBack to fetch the contents of the directory
-//	from disk, and to write back any modifications back to disk.
+//	The table is kept by linear hashing.  Sector 0 of the directory
+//	file is a header; bucket b is sector 1 + b, and overflow page k
+//	is sector MaxBuckets + k.  A name is looked up by reading the
+//	header and the pages of its bucket -- usually just one.  Adding
+//	a name may split one bucket into two, which rewrites only the
+//	pages of that bucket; so a directory grows a little at a time,
+//	and never has to be copied.  A split is put off while that is more
+//	than the Add's transaction has room for.  Removing a name does not
+//	shrink the table.
 //
-//	Also, this implementation has the restriction that the size
-//	of the directory cannot expand.  In other words, once all the
-//	entries in the directory are used, no more files can be created.
+//	The pages are written as soon as they change, through the open
+//	directory file, which makes itself longer and takes disk space
+//	for its holes as it must.  Operations that change the directory
+//	should be done inside a transaction of the journal.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -21,86 +28,187 @@
 
 #include "copyright.h"
 #include "utility.h"
+#include "debug.h"
 #include "filehdr.h"
 #include "directory.h"
+#include "main.h"
 
 //----------------------------------------------------------------------
 // Directory::Directory
-// 	Initialize a directory; initially, the directory is completely
-//	empty.  If the disk is being formatted, an empty directory
-//	is all we need, but otherwise, we need to call FetchFrom in order
-//	to initialize it from disk.
+// 	Use the directory held in an open file, reading in its header.
+//	If the directory file is new, Format must be called before
+//	anything else.
 //
-//	"size" is the number of entries in the directory
+//	"file" -- file containing the directory contents
 //----------------------------------------------------------------------
 
-Directory::Directory(int size)
+Directory::Directory(OpenFile *file)
 {
-    table = new DirectoryEntry[size];
-	
-	// MP4 mod tag
-	memset(table, 0, sizeof(DirectoryEntry) * size);  // dummy operation to keep valgrind happy
-	
-    tableSize = size;
-    
-    //MP4 modified
-    for (int i = 0; i < tableSize; i++){
-	    table[i].inUse = FALSE;
-        table[i].is_file = FALSE;
-    }
+    ASSERT(sizeof(DirectoryPage) <= SectorSize);
+    ASSERT(sizeof(DirectoryHeader) == SectorSize);
+    this->file = file;
+    ReadPage(0, (char *) &header);
 }
 
 //----------------------------------------------------------------------
 // Directory::~Directory
-// 	De-allocate directory data structure.
+// 	De-allocate directory data structure.  The file is the caller's
+//	to close.
 //----------------------------------------------------------------------
 
 Directory::~Directory()
 { 
-    delete [] table;
-} 
+}
 
 //----------------------------------------------------------------------
-// Directory::FetchFrom
-// 	Read the contents of the directory from disk.
-//
-//	"file" -- file containing the directory contents
+// Directory::Format
+// 	Make the directory empty, with InitialBuckets empty buckets.
+//	Only the header is written: the buckets are holes.  The header
+//	sector of the file must have disk space already.
 //----------------------------------------------------------------------
 
 void
-Directory::FetchFrom(OpenFile *file)
+Directory::Format()
 {
-    (void) file->ReadAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    bool written;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = DirectoryMagic;
+    written = WritePage(0, (char *) &header);
+    ASSERT(written);
 }
 
 //----------------------------------------------------------------------
-// Directory::WriteBack
-// 	Write any modifications to the directory back to disk
-//
-//	"file" -- file to contain the new directory contents
+// Directory::ReadPage
+// 	Read the page'th sector of the directory file.  A page past the
+//	end of the file has never been written, and reads as empty, as
+//	does a hole.
 //----------------------------------------------------------------------
 
 void
-Directory::WriteBack(OpenFile *file)
+Directory::ReadPage(int page, char *into)
+{
+    memset(into, 0, SectorSize);
+    (void) file->ReadAt(into, SectorSize, page * SectorSize);
+}
+
+//----------------------------------------------------------------------
+// Directory::WritePage
+// 	Write the page'th sector of the directory file.  Return FALSE if
+//	there was no disk space for it.
+//----------------------------------------------------------------------
+
+bool
+Directory::WritePage(int page, char *from)
+{
+    return file->WriteAt(from, SectorSize, page * SectorSize) == SectorSize;
+}
+
+//----------------------------------------------------------------------
+// Directory::Hash
+// 	Hash a name.  Only the part of the name that is kept in an entry
+//	is hashed, so that a name too long to keep is found again.
+//----------------------------------------------------------------------
+
+unsigned int
+Directory::Hash(char *name)
+{
+    unsigned int h = 0;
+
+    for (int i = 0; i < FileNameMaxLen && name[i] != '\0'; i++)
+	h = h * 31 + (unsigned char) name[i];
+    return h ^ (h >> 16);
+}
+
+//----------------------------------------------------------------------
+// Directory::NumBuckets, Directory::Bucket
+// 	The size of the table, and which bucket of it holds "name": by
+//	the hash modulo the size of this round, or of the next round if
+//	that bucket has been split already.
+//----------------------------------------------------------------------
+
+int
+Directory::NumBuckets()
 {
-    (void) file->WriteAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    return (InitialBuckets << header.level) + header.next;
 }
 
+int
+Directory::Bucket(char *name)
+{
+    unsigned int h = Hash(name);
+    int bucket;
+
+    ASSERT(header.magic == DirectoryMagic);	// formatted?
+    bucket = h % (InitialBuckets << header.level);
+    if (bucket < header.next)
+	bucket = h % (InitialBuckets << (header.level + 1));
+    return bucket;
+}
+
+//----------------------------------------------------------------------
+// Directory::BucketPage, Directory::OverflowPage
+// 	Where in the directory file a bucket, or an overflow page, is.
+//----------------------------------------------------------------------
+
+int
+Directory::BucketPage(int bucket)
+{
+    return 1 + bucket;
+}
+
+int
+Directory::OverflowPage(int overflow)
+{
+    return MaxBuckets + overflow;
+}
+
+//----------------------------------------------------------------------
+// Directory::ChainLength
+// 	Return the number of pages in a bucket.
 //----------------------------------------------------------------------
-// Directory::FindIndex
-// 	Look up file name in directory, and return its location in the table of
-//	directory entries.  Return -1 if the name isn't in the directory.
+
+int
+Directory::ChainLength(int bucket)
+{
+    DirectoryPage page;
+    int length = 1;
+
+    ReadPage(BucketPage(bucket), (char *) &page);
+    while (page.overflow != 0) {
+	ReadPage(OverflowPage(page.overflow), (char *) &page);
+	length++;
+    }
+    return length;
+}
+
+//----------------------------------------------------------------------
+// Directory::FindEntry
+// 	Look up file name in directory, reading the pages of its bucket
+//	until it turns up.  Return TRUE and copy its entry to "entry" if
+//	it is found.
 //
 //	"name" -- the file name to look up
 //----------------------------------------------------------------------
 
-int
-Directory::FindIndex(char *name)
+bool
+Directory::FindEntry(char *name, DirectoryEntry *entry)
 {
-    for (int i = 0; i < tableSize; i++)
-        if (table[i].inUse && !strncmp(table[i].name, name, FileNameMaxLen))
-	    return i;
-    return -1;		// name not in directory
+    DirectoryPage page;
+    int i;
+
+    ReadPage(BucketPage(Bucket(name)), (char *) &page);
+    for (;;) {
+	for (i = 0; i < EntriesPerPage; i++)
+	    if (page.entries[i].inUse 
+			&& !strncmp(page.entries[i].name, name, FileNameMaxLen)) {
+		*entry = page.entries[i];
+		return TRUE;
+	    }
+	if (page.overflow == 0)
+	    return FALSE;		// name not in directory
+	ReadPage(OverflowPage(page.overflow), (char *) &page);
+    }
 }
 
 //----------------------------------------------------------------------
@@ -115,19 +223,22 @@ Directory::FindIndex(char *name)
 int
 Directory::Find(char *name)
 {
-    int i = FindIndex(name);
+    DirectoryEntry entry;
 
-    if (i != -1)
-	return table[i].sector;
+    if (FindEntry(name, &entry))
+	return entry.sector;
     return -1;
 }
 
 //----------------------------------------------------------------------
 // Directory::Add
 // 	Add a file into the directory.  Return TRUE if successful;
-//	return FALSE if the file name is already in the directory, or if
-//	the directory is completely full, and has no more space for
-//	additional file names.
+//	return FALSE if the file name is already in the directory, or
+//	if there is no disk space for the directory to grow.
+//
+//	The entry goes in the first free slot of its bucket; if there is
+//	none, a new overflow page is chained on the end of the bucket.
+//	Then, if the table is more than half full, a bucket is split.
 //
 //	"name" -- the name of the file being added
 //	"newSector" -- the disk sector containing the added file's header
@@ -136,21 +247,188 @@ Directory::Find(char *name)
 bool
 Directory::Add(char *name, int newSector, bool is_file)
 { 
-    if (FindIndex(name) != -1)
+    DirectoryPage page, fresh;
+    DirectoryEntry *entry;
+    int pageNum, overflow, i;
+    bool written;
+
+    if (Find(name) != -1)
 	return FALSE;
 
-    for (int i = 0; i < tableSize; i++)
-        if (!table[i].inUse) {
-            //MP4 modified
-            if(is_file){
-                table[i].is_file = TRUE;
-            }
-            table[i].inUse = TRUE;
-            strncpy(table[i].name, name, FileNameMaxLen); 
-            table[i].sector = newSector;
-        return TRUE;
+    pageNum = BucketPage(Bucket(name));
+    ReadPage(pageNum, (char *) &page);
+    while (page.count == EntriesPerPage && page.overflow != 0) {
+	pageNum = OverflowPage(page.overflow);
+	ReadPage(pageNum, (char *) &page);
+    }
+
+    memset(&fresh, 0, sizeof(fresh));
+    if (page.count == EntriesPerPage) {
+	// the bucket is full: the entry goes on a new page, which must
+	// be on disk before the bucket points to it
+	overflow = NewOverflow();
+	entry = &fresh.entries[0];
+	fresh.count = 1;
+    } else {
+	overflow = 0;
+	for (i = 0; page.entries[i].inUse; i++)
+	    ;
+	entry = &page.entries[i];
+	page.count++;
+    }
+    entry->inUse = TRUE;
+    //MP4 modified
+    entry->is_file = is_file;
+    entry->sector = newSector;
+    strncpy(entry->name, name, FileNameMaxLen); 
+    entry->name[FileNameMaxLen] = '\0';
+
+    if (overflow != 0) {
+	if (!WritePage(OverflowPage(overflow), (char *) &fresh))
+	    return FALSE;		// no space: the header is not written,
+					// so the page is not taken either
+	page.overflow = overflow;
+    }
+    if (!WritePage(pageNum, (char *) &page))
+	return FALSE;			// no space for the bucket's page
+
+    header.numEntries++;
+    if (header.numEntries * 2 > NumBuckets() * EntriesPerPage)
+	Split();
+    written = WritePage(0, (char *) &header);
+    ASSERT(written);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Directory::NewOverflow
+// 	Return the number of an overflow page nobody is using: the first
+//	one on the free chain, or else one past the last ever used.  The
+//	change is to the in-core header only.
+//----------------------------------------------------------------------
+
+int
+Directory::NewOverflow()
+{
+    DirectoryPage page;
+    int overflow;
+
+    if (header.freeOverflow == 0)
+	return ++header.numOverflow;
+    overflow = header.freeOverflow;
+    ReadPage(OverflowPage(overflow), (char *) &page);
+    header.freeOverflow = page.overflow;
+    return overflow;
+}
+
+//----------------------------------------------------------------------
+// Directory::FreeOverflow
+// 	Put an overflow page nobody uses any more on the free chain.
+//	Its space is allocated already, so writing it cannot fail.
+//----------------------------------------------------------------------
+
+void
+Directory::FreeOverflow(int overflow)
+{
+    DirectoryPage page;
+    bool written;
+
+    memset(&page, 0, sizeof(page));
+    page.overflow = header.freeOverflow;
+    written = WritePage(OverflowPage(overflow), (char *) &page);
+    ASSERT(written);
+    header.freeOverflow = overflow;
+}
+
+//----------------------------------------------------------------------
+// Directory::Split
+// 	Split the next bucket in line in two: the bucket's entries are
+//	dealt out between it and a new bucket at the end of the table,
+//	by the hash modulo the size of the next round.  The pages the
+//	bucket had are reused, so that only the new bucket's page needs
+//	disk space; if there is none, the split is put off until the
+//	next Add.  It is put off as well if the current transaction has
+//	no room to log all those pages (see SplitReserveBlocks), as can
+//	happen to a bucket whose names' hashes collide: the split has to
+//	wait for an Add that comes with more room.  Once the table has
+//	MaxBuckets buckets, only the overflow chains grow.
+//----------------------------------------------------------------------
+
+void
+Directory::Split()
+{
+    int roundSize = InitialBuckets << header.level;
+    int bucket[2], pageNum[2];
+    DirectoryPage out[2], *chain;
+    DirectoryEntry *entry;
+    int *spare, numSpare, used, length, i, j, b;
+    bool written;
+
+    bucket[0] = header.next;
+    bucket[1] = header.next + roundSize;
+    if (bucket[1] >= MaxBuckets)
+	return;				// as big as the table gets
+
+    length = ChainLength(bucket[0]);
+    if (length + SplitReserveBlocks > kernel->fileSystem->RoomLeft()) {
+	DEBUG(dbgFile, "Putting off the split of directory bucket "
+		<< bucket[0] << ", " << length << " pages long");
+	return;				// too many pages for the transaction
+    }
+    memset(&out[1], 0, sizeof(DirectoryPage));
+    if (!WritePage(BucketPage(bucket[1]), (char *) &out[1]))
+	return;				// no room for the new bucket
+
+    // read in the old bucket, remembering its overflow pages
+    chain = new DirectoryPage[length];
+    spare = new int[length];
+    numSpare = 0;
+    ReadPage(BucketPage(bucket[0]), (char *) &chain[0]);
+    for (i = 1; i < length; i++) {
+	spare[numSpare++] = chain[i - 1].overflow;
+	ReadPage(OverflowPage(chain[i - 1].overflow), (char *) &chain[i]);
+    }
+
+    header.next++;
+    if (header.next == roundSize) {	// every bucket is split: next round
+	header.level++;
+	header.next = 0;
+    }
+    DEBUG(dbgFile, "Splitting directory bucket " << bucket[0] << " into "
+		<< bucket[1] << ", " << NumBuckets() << " buckets now");
+
+    // deal the entries out; the two new chains need at most one page
+    // more than the old one had, which is the new bucket's
+    used = 0;
+    for (b = 0; b < 2; b++) {
+	memset(&out[b], 0, sizeof(DirectoryPage));
+	pageNum[b] = BucketPage(bucket[b]);
+    }
+    for (i = 0; i < length; i++)
+	for (j = 0; j < EntriesPerPage; j++) {
+	    entry = &chain[i].entries[j];
+	    if (!entry->inUse)
+		continue;
+	    b = (Bucket(entry->name) == bucket[0]) ? 0 : 1;
+	    if (out[b].count == EntriesPerPage) {
+		ASSERT(used < numSpare);
+		out[b].overflow = spare[used++];
+		written = WritePage(pageNum[b], (char *) &out[b]);
+		ASSERT(written);
+		pageNum[b] = OverflowPage(out[b].overflow);
+		memset(&out[b], 0, sizeof(DirectoryPage));
+	    }
+	    out[b].entries[out[b].count++] = *entry;
 	}
-    return FALSE;	// no space.  Fix when we have extensible files.
+    for (b = 0; b < 2; b++) {
+	written = WritePage(pageNum[b], (char *) &out[b]);
+	ASSERT(written);
+    }
+    while (used < numSpare)
+	FreeOverflow(spare[used++]);
+
+    delete [] chain;
+    delete [] spare;
 }
 
 //----------------------------------------------------------------------
@@ -164,33 +442,57 @@ Directory::Add(char *name, int newSector, bool is_file)
 bool
 Directory::Remove(char *name)
 { 
-    int i = FindIndex(name);
+    DirectoryPage page;
+    int pageNum, i;
+    bool written;
 
-    if (i == -1)
-	return FALSE; 		// name not in directory
-    table[i].inUse = FALSE;
-    table[i].is_file = FALSE;
-    return TRUE;	
+    pageNum = BucketPage(Bucket(name));
+    for (;;) {
+	ReadPage(pageNum, (char *) &page);
+	for (i = 0; i < EntriesPerPage; i++)
+	    if (page.entries[i].inUse 
+			&& !strncmp(page.entries[i].name, name, FileNameMaxLen)) {
+		memset(&page.entries[i], 0, sizeof(DirectoryEntry));
+		page.count--;
+		written = WritePage(pageNum, (char *) &page);
+		ASSERT(written);
+		header.numEntries--;
+		written = WritePage(0, (char *) &header);
+		ASSERT(written);
+		return TRUE;
+	    }
+	if (page.overflow == 0)
+	    return FALSE; 		// name not in directory
+	pageNum = OverflowPage(page.overflow);
+    }
 }
 
 //----------------------------------------------------------------------
 // Directory::List
-// 	List all the file names in the directory. 
+// 	List all the file names in the directory, bucket by bucket. 
 //----------------------------------------------------------------------
 
 void
 Directory::List()
 {
-   for (int i = 0; i < tableSize; i++){
-	if (table[i].inUse){
-        if(table[i].is_file){
-            cout<<table[i].name<<"[file]"<<endl;
-        }else{
-            cout<<table[i].name<<"[directory]"<<endl;
-        }
+    DirectoryPage page;
+
+    for (int b = 0; b < NumBuckets(); b++) {
+	ReadPage(BucketPage(b), (char *) &page);
+	for (;;) {
+	    for (int i = 0; i < EntriesPerPage; i++)
+		if (page.entries[i].inUse) {
+		    if (page.entries[i].is_file)
+			cout<<page.entries[i].name<<"[file]"<<endl;
+		    else
+			cout<<page.entries[i].name<<"[directory]"<<endl;
+		}
+	    if (page.overflow == 0)
+		break;
+	    ReadPage(OverflowPage(page.overflow), (char *) &page);
+	}
     }
-   }
-   cout<<"end list"<<endl;
+    cout<<"end list"<<endl;
 }
 
 //----------------------------------------------------------------------
@@ -203,14 +505,25 @@ void
 Directory::Print()
 { 
     FileHeader *hdr = new FileHeader;
+    DirectoryPage page;
 
-    printf("Directory contents:\n");
-    for (int i = 0; i < tableSize; i++)
-	if (table[i].inUse) {
-	    printf("Name: %s, Sector: %d\n", table[i].name, table[i].sector);
-	    hdr->FetchFrom(table[i].sector);
-	    hdr->Print();
+    printf("Directory contents: %d names in %d buckets, %d overflow pages\n",
+		header.numEntries, NumBuckets(), header.numOverflow);
+    for (int b = 0; b < NumBuckets(); b++) {
+	ReadPage(BucketPage(b), (char *) &page);
+	for (;;) {
+	    for (int i = 0; i < EntriesPerPage; i++)
+		if (page.entries[i].inUse) {
+		    printf("Name: %s, Sector: %d\n", page.entries[i].name,
+				page.entries[i].sector);
+		    hdr->FetchFrom(page.entries[i].sector);
+		    hdr->Print();
+		}
+	    if (page.overflow == 0)
+		break;
+	    ReadPage(OverflowPage(page.overflow), (char *) &page);
 	}
+    }
     printf("\n");
     delete hdr;
 }
@@ -218,30 +531,214 @@ Directory::Print()
 //MP4 modified
 void Directory::RecursivelyList()
 {
-    Directory *subDirectory = new Directory(NumDirEntries);
+    DirectoryPage page;
+    DirectoryEntry *entry;
     int number = 1;
-    for(int i=0;i<tableSize;i++){
-        if(table[i].inUse){
-            if(table[i].is_file){
-                cout<<number<<":"<<table[i].name<<"[file]"<<endl;
-            }else{
-                cout<<number<<":"<<table[i].name<<"[directory]"<<endl;
-                OpenFile *tmpFile = new OpenFile(table[i].sector);
-                subDirectory -> FetchFrom(tmpFile);
-                subDirectory -> RecursivelyList();
-                delete tmpFile;
+
+    for (int b = 0; b < NumBuckets(); b++) {
+        ReadPage(BucketPage(b), (char *) &page);
+        for (;;) {
+            for (int i = 0; i < EntriesPerPage; i++) {
+                entry = &page.entries[i];
+                if (!entry->inUse)
+                    continue;
+                if (entry->is_file) {
+                    cout<<number<<":"<<entry->name<<"[file]"<<endl;
+                } else {
+                    cout<<number<<":"<<entry->name<<"[directory]"<<endl;
+                    OpenFile *tmpFile = new OpenFile(entry->sector);
+                    Directory *subDirectory = new Directory(tmpFile);
+                    subDirectory -> RecursivelyList();
+                    delete subDirectory;
+                    delete tmpFile;
+                }
+                number++;
             }
-            number++;
+            if (page.overflow == 0)
+                break;
+            ReadPage(OverflowPage(page.overflow), (char *) &page);
         }
     }
-    delete subDirectory;
 }
 bool Directory::IsFile(char *name)
 {
-    int i = FindIndex(name);
-    if(i != -1){
-        return table[i].is_file;
-    }else{
-        return FALSE;
+    DirectoryEntry entry;
+
+    if (FindEntry(name, &entry))
+        return entry.is_file;
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::DentryCache
+// 	Initialize the dentry cache.  It starts out empty, with every
+//	entry on the LRU list.
+//----------------------------------------------------------------------
+
+DentryCache::DentryCache()
+{
+    int i;
+
+    dentries = new Dentry[NumDentries];
+    for (i = 0; i < NumDentryBuckets; i++)
+	buckets[i] = NULL;
+    for (i = 0; i < NumDentries; i++) {
+	dentries[i].parent = -1;
+	dentries[i].hashNext = NULL;
+	dentries[i].lruPrev = (i > 0) ? &dentries[i - 1] : NULL;
+	dentries[i].lruNext = (i < NumDentries - 1) ? &dentries[i + 1] : NULL;
     }
-}
\ No newline at end of file
+    lruHead = &dentries[0];
+    lruTail = &dentries[NumDentries - 1];
+}
+
+//----------------------------------------------------------------------
+// DentryCache::~DentryCache
+// 	De-allocate the dentry cache.
+//----------------------------------------------------------------------
+
+DentryCache::~DentryCache()
+{
+    delete [] dentries;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Lookup
+// 	Return TRUE if the result of looking up "name" in the directory
+//	at "parent" is known, setting "*sector" to the sector of its
+//	header (-1 if there is no such name) and "*is_file" to its type.
+//----------------------------------------------------------------------
+
+bool
+DentryCache::Lookup(int parent, char *name, int *sector, bool *is_file)
+{
+    Dentry *entry = Find(parent, name);
+
+    if (entry == NULL)
+	return FALSE;
+    Touch(entry);
+    *sector = entry->sector;
+    *is_file = entry->is_file;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Enter
+// 	Record that "name" in the directory at "parent" has its header at
+//	"sector" (-1 if the name is absent), replacing anything known
+//	before.  If it is new, it takes the least recently used entry.
+//----------------------------------------------------------------------
+
+void
+DentryCache::Enter(int parent, char *name, int sector, bool is_file)
+{
+    Dentry *entry = Find(parent, name);
+    int bucket;
+
+    if (entry == NULL) {
+	entry = lruTail;
+	if (entry->parent != -1)
+	    Unhash(entry);
+	entry->parent = parent;
+	strncpy(entry->name, name, FileNameMaxLen);
+	entry->name[FileNameMaxLen] = '\0';
+	bucket = Hash(parent, name);
+	entry->hashNext = buckets[bucket];
+	buckets[bucket] = entry;
+    }
+    entry->sector = sector;
+    entry->is_file = is_file;
+    Touch(entry);
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Purge
+// 	Forget every lookup made in the directory at "parent", since the
+//	directory has been removed (and its sector may be reused).
+//----------------------------------------------------------------------
+
+void
+DentryCache::Purge(int parent)
+{
+    for (int i = 0; i < NumDentries; i++)
+	if (dentries[i].parent == parent) {
+	    Unhash(&dentries[i]);
+	    dentries[i].parent = -1;
+	}
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Find
+// 	Return the entry for "name" in "parent", or NULL.  Names are
+//	compared the way Directory::FindEntry does.
+//----------------------------------------------------------------------
+
+Dentry *
+DentryCache::Find(int parent, char *name)
+{
+    Dentry *entry = buckets[Hash(parent, name)];
+
+    while (entry != NULL && (entry->parent != parent 
+		|| strncmp(entry->name, name, FileNameMaxLen)))
+	entry = entry->hashNext;
+    return entry;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Hash
+// 	Return the hash chain for "name" in "parent".  Only the part of
+//	the name that is significant to a directory is hashed.
+//----------------------------------------------------------------------
+
+int
+DentryCache::Hash(int parent, char *name)
+{
+    unsigned int h = parent;
+
+    for (int i = 0; i < FileNameMaxLen && name[i] != '\0'; i++)
+	h = h * 31 + (unsigned char) name[i];
+    return h % NumDentryBuckets;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Touch
+// 	Move an entry to the front of the LRU list.
+//----------------------------------------------------------------------
+
+void
+DentryCache::Touch(Dentry *entry)
+{
+    if (entry == lruHead)
+	return;
+
+    // unlink
+    entry->lruPrev->lruNext = entry->lruNext;
+    if (entry->lruNext != NULL)
+	entry->lruNext->lruPrev = entry->lruPrev;
+    else
+	lruTail = entry->lruPrev;
+
+    // relink at the front
+    entry->lruPrev = NULL;
+    entry->lruNext = lruHead;
+    lruHead->lruPrev = entry;
+    lruHead = entry;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Unhash
+// 	Remove an entry from its hash chain.
+//----------------------------------------------------------------------
+
+void
+DentryCache::Unhash(Dentry *entry)
+{
+    Dentry **ptr = &buckets[Hash(entry->parent, entry->name)];
+
+    while (*ptr != entry) {
+	ASSERT(*ptr != NULL);		// entry must be on its chain
+	ptr = &(*ptr)->hashNext;
+    }
+    *ptr = entry->hashNext;
+    entry->hashNext = NULL;
+}
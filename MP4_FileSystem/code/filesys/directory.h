@@ -6,6 +6,10 @@
 //	where to find its file header (the data structure describing
 //	where to find the file's data blocks) on disk.
 //
+//	On disk, the table is a hash table kept by linear hashing, so
+//	that looking a name up reads only the few sectors of the
+//	directory file it may be in, however many names there are.
+//
 //      We assume mutual exclusion is provided by the caller.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
@@ -17,13 +21,11 @@
 #ifndef DIRECTORY_H
 #define DIRECTORY_H
 
+#include "disk.h"
 #include "openfile.h"
 
-#define FileNameMaxLen 		9	// for simplicity, we assume 
-					// file names are <= 9 characters long
-
-//MP4 modified
-#define NumDirEntries 64
+#define FileNameMaxLen 		33	// file names are <= 33 characters
+					// long; longer ones are cut short
 
 // The following class defines a "directory entry", representing a file
 // in the directory.  Each entry gives the name of the file, and where
@@ -34,36 +36,89 @@
 
 class DirectoryEntry {
   public:
+    int sector;				// Location on disk to find the 
+					//   FileHeader for this file 
+    bool inUse;				// Is this directory entry in use?
 
     //MP4 modified
     bool is_file;
 
-    bool inUse;				// Is this directory entry in use?
-    int sector;				// Location on disk to find the 
-					//   FileHeader for this file 
     char name[FileNameMaxLen + 1];	// Text name for file, with +1 for 
 					// the trailing '\0'
 };
 
+// The shape of the hash table.  It starts out with InitialBuckets
+// buckets, and gains one (by splitting another in two) whenever the
+// entries would fill more than half of its pages, up to MaxBuckets.
+// Each bucket is a page -- a sector of the directory file -- holding
+// EntriesPerPage entries; a bucket that overflows is chained onto
+// overflow pages, which are kept in the directory file after the
+// last possible bucket.  Pages nobody has written yet are holes in
+// the directory file, and read as empty.
+
+const int EntriesPerPage = (SectorSize - 2 * sizeof(int))
+					/ sizeof(DirectoryEntry);
+const int InitialBuckets = 4;
+const int MaxBuckets = 16384;
+const int DirectoryMagic = 0x48444952;	// marks a formatted directory
+
+// A split rewrites every page of the bucket it splits, inside the
+// transaction of the Add that set it off, so it is put off to a later
+// Add while those pages, and SplitReserveBlocks more, do not fit in
+// what is left of the transaction (see FileSystem::RoomLeft).  The
+// reserve is for the new bucket's page; the 14 sectors giving it
+// space may log (a bitmap sector, up to 6 index blocks and a bitmap
+// sector for each, and the directory file's header); the directory
+// header; and the file header and directory page the caller of Add
+// may write after it.
+
+const int SplitReserveBlocks = 1 + 14 + 1 + 2;
+
+// The following class defines one page of a bucket.  A page's slots
+// are used in no particular order.
+
+class DirectoryPage {
+  public:
+    int overflow;			// Next page of the bucket (the
+					// # of an overflow page), or 0
+    int count;				// # of entries in use
+    DirectoryEntry entries[EntriesPerPage];
+};
+
+// The following class defines the first sector of a directory file,
+// which tells how far the hash table has grown.
+//
+// Linear hashing splits the buckets in order: in round "level", there
+// are InitialBuckets << level buckets to begin with, and those before
+// "next" have been split already; the ones they were split into are
+// at the end of the table.
+
+class DirectoryHeader {
+  public:
+    int magic;				// DirectoryMagic
+    int level;				// Round of splitting
+    int next;				// Next bucket to split
+    int numEntries;			// # of names in the directory
+    int numOverflow;			// # of overflow pages ever used
+    int freeOverflow;			// First unused overflow page, or 0;
+					// they are chained by "overflow"
+    char unused[SectorSize - 6 * sizeof(int)];
+};
+
 // The following class defines a UNIX-like "directory".  Each entry in
 // the directory describes a file, and where to find it on disk.
 //
-// The directory data structure can be stored in memory, or on disk.
-// When it is on disk, it is stored as a regular Nachos file.
-//
-// The constructor initializes a directory structure in memory; the
-// FetchFrom/WriteBack operations shuffle the directory information
-// from/to disk. 
+// A Directory is bound to the open file that holds it, and reads and
+// writes the pages of the hash table directly, a sector at a time;
+// only the header is kept in memory.  A new directory file must be
+// given Format before anything else.
 
 class Directory {
   public:
-    Directory(int size); 		// Initialize an empty directory
-					// with space for "size" files
+    Directory(OpenFile *file); 		// Use the directory in "file"
     ~Directory();			// De-allocate the directory
 
-    void FetchFrom(OpenFile *file);  	// Init directory contents from disk
-    void WriteBack(OpenFile *file);	// Write modifications to 
-					// directory contents back to disk
+    void Format();			// Make it an empty directory
 
     int Find(char *name);		// Find the sector number of the 
 					// FileHeader for file: "name"
@@ -82,20 +137,84 @@ class Directory {
 					//  names and their contents.
 
   private:
-  
-	/*
-		MP4 Hint:
-		Directory is actually a "file", be careful of how it works with OpenFile and FileHdr.
-		Disk part: table
-		In-core part: tableSize
-	*/
-  
-    int tableSize;			// Number of directory entries
-    DirectoryEntry *table;		// Table of pairs: 
-					// <file name, file header location> 
-
-    int FindIndex(char *name);		// Find the index into the directory 
-					//  table corresponding to "name"
+    OpenFile *file;			// The directory file
+    DirectoryHeader header;		// In-core copy of its first sector
+
+    bool FindEntry(char *name, DirectoryEntry *entry);
+					// Copy the entry for "name" to
+					// "entry", if there is one
+    unsigned int Hash(char *name);	// Hash of the significant part
+    int Bucket(char *name);		// Which bucket is "name" in?
+    int NumBuckets();			// # of buckets in the table
+    int BucketPage(int bucket);		// Where in the file is a bucket
+    int OverflowPage(int overflow);	//  or an overflow page?
+    int ChainLength(int bucket);	// # of pages in a bucket
+
+    int NewOverflow();			// Take an unused overflow page
+    void FreeOverflow(int overflow);	// and give it back
+    void Split();			// Split the next bucket in two
+
+    void ReadPage(int page, char *into);
+					// Read/write the page'th sector of
+    bool WritePage(int page, char *from);
+					// the directory file
+};
+
+// Size of the dentry cache, which remembers the results of looking
+// names up in directories, so that walking a path does not have to
+// read every directory along the way.
+
+const int NumDentries = 128;		// # of lookups remembered
+const int NumDentryBuckets = 31;	// # of hash chains (prime)
+
+// The following class defines one remembered lookup: "name" in the
+// directory whose header is at sector "parent" was found to have its
+// header at "sector" -- or, if "sector" is -1, to be absent.
+//
+// Internal data structures kept public so that DentryCache can
+// access them directly.
+
+class Dentry {
+  public:
+    int parent;				// Header sector of the directory
+					// searched, -1 if the entry is free
+    char name[FileNameMaxLen + 1];	// Name looked up
+    int sector;				// Header sector found, or -1
+    bool is_file;			// Is it a file or a directory?
+    Dentry *hashNext;			// next entry in the same hash chain
+    Dentry *lruPrev;			// neighbours in the LRU chain;
+    Dentry *lruNext;			//  most recently used at the front
+};
+
+// The following class defines the dentry cache: a hash table of
+// (directory, name) lookups, replaced in least-recently-used order.
+// The file system must keep it up to date whenever it adds or removes
+// a directory entry.
+
+class DentryCache {
+  public:
+    DentryCache();			// Initialize an empty cache
+    ~DentryCache();			// De-allocate the cache
+
+    bool Lookup(int parent, char *name, int *sector, bool *is_file);
+					// Is "name" in "parent" known?  If
+					// so, return where (-1: absent)
+    void Enter(int parent, char *name, int sector, bool is_file);
+					// Remember the result of a lookup,
+					// or a change to the directory
+    void Purge(int parent);		// Forget everything about the
+					// directory at sector "parent"
+
+  private:
+    Dentry *dentries;			// The cache entries
+    Dentry *buckets[NumDentryBuckets];	// Hash chains, by (parent, name)
+    Dentry *lruHead;			// Most recently used entry
+    Dentry *lruTail;			// Least recently used entry
+
+    Dentry *Find(int parent, char *name); // Find a cached entry, or NULL
+    int Hash(int parent, char *name);	// Which hash chain?
+    void Touch(Dentry *entry);		// Move entry to the front of the LRU
+    void Unhash(Dentry *entry);		// Take entry off its hash chain
 };
 
 #endif // DIRECTORY_H
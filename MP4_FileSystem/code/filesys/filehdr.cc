@@ -10,6 +10,13 @@
 //	blocks). The table size is chosen so that the file header
 //	will be just big enough to fit in one disk sector, 
 //
+//	A file small enough to fit in the sector table keeps its data
+//	there instead, and has no data sectors at all.
+//
+//	Files are sparse: an entry of -1 anywhere in the index is a hole,
+//	standing for sectors (or a whole subtree of index) that have never
+//	been written, and that read back as zeroes.
+//
 //      Unlike in a real system, we do not keep track of file permissions, 
 //	ownership, last modification date, etc., in the file header. 
 //
@@ -46,6 +53,7 @@ FileHeader::FileHeader()
 	numBytes = -1;
 	numSectors = -1;
 	memset(dataSectors, -1, sizeof(dataSectors));
+	mapVersion = 0;
 }
 
 //----------------------------------------------------------------------
@@ -60,85 +68,460 @@ FileHeader::~FileHeader()
 	// nothing to do now
 }
 
+//----------------------------------------------------------------------
+// ExtentAllocator
+// 	Hands out the sectors for a file being allocated.  Rather than
+//	taking free sectors one at a time wherever the first-fit scan
+//	lands, it claims whole runs of contiguous free sectors, as long as
+//	the number of sectors the file still needs.  When the disk is too
+//	fragmented for that, it settles for runs half as long, and so on.
+//	The file's index and data sectors are handed out in the order
+//	Allocate visits them, so each index block sits right in front of
+//	the data it maps.
+//----------------------------------------------------------------------
+
+class ExtentAllocator {
+  public:
+    ExtentAllocator(PersistentBitmap *map, int count);
+    int Next();			// Return the next sector for the file
+
+  private:
+    PersistentBitmap *freeMap;
+    int needed;			// sectors not yet handed out
+    int next;			// next sector of the current run
+    int left;			// sectors left in the current run
+};
+
+ExtentAllocator::ExtentAllocator(PersistentBitmap *map, int count)
+{
+    freeMap = map;
+    needed = count;
+    next = left = 0;
+}
+
+int
+ExtentAllocator::Next()
+{
+    int want, start = -1;
+
+    ASSERT(needed > 0);
+    if (left == 0) {		// current run used up, claim another
+	for (want = needed; want > 0; want /= 2) {
+	    start = freeMap->FindRun(want);
+	    if (start != -1)
+		break;
+	}
+	// since the caller checked that there was enough free space,
+	// we expect to find at least a single free sector
+	ASSERT(start != -1);
+	DEBUG(dbgFile, "Claiming extent of " << want << " sectors at " << start);
+	for (int i = 0; i < want; i++)
+	    freeMap->Mark(start + i);
+	next = start;
+	left = want;
+    }
+    needed--;
+    left--;
+    return next++;
+}
+
+//----------------------------------------------------------------------
+// SpanOf
+// 	Return how many data sectors each child of an index block maps,
+//	when the index block maps "sectors" data sectors in all; 0 if
+//	that few sectors fit directly in the block.  A file gets one
+//	more level of index each time it outgrows NumDirect children.
+//----------------------------------------------------------------------
+
+#define MaxFileSectors	(NumDirect * NumDirect * NumDirect * NumDirect)
+
+static int
+SpanOf(int sectors)
+{
+    if (sectors <= (int) NumDirect)
+	return 0;
+    if (sectors <= (int) (NumDirect * NumDirect))
+	return NumDirect;
+    if (sectors <= (int) (NumDirect * NumDirect * NumDirect))
+	return NumDirect * NumDirect;
+    return NumDirect * NumDirect * NumDirect;
+}
+
+//----------------------------------------------------------------------
+// HoleCost
+// 	Return the number of sectors, data plus index, needed to map the
+//	"count" file sectors starting at "first" within a hole -- an index
+//	entry of -1, standing for "capacity" sectors none of which have
+//	been allocated yet.
+//----------------------------------------------------------------------
+
+static int
+HoleCost(int capacity, int first, int count)
+{
+    int span = SpanOf(capacity);
+    int i, lo, hi, total = 0;
+
+    if (span == 0)
+	return count;
+    for (i = first / span; i * span < first + count; i++) {
+	lo = max(first, i * span) - i * span;
+	hi = min(first + count, (i + 1) * span) - i * span;
+	total += 1 + HoleCost(min(capacity - i * span, span), lo, hi - lo);
+    }
+    return total;
+}
+
 //----------------------------------------------------------------------
 // FileHeader::Allocate
 // 	Initialize a fresh file header for a newly created file.
-//	Allocate data blocks for the file out of the map of free disk blocks.
-//	Return FALSE if there are not enough free blocks to accomodate
-//	the new file.
+//	Return FALSE if the file would be bigger than the index can map.
+//
+//	No disk space is taken here: every entry of the index starts out
+//	as a hole (-1), which reads back as zeroes, and sectors are only
+//	allocated when they are first written (see Fill).  So creating a
+//	file costs the same whatever its size.  A file of at most
+//	MaxInlineBytes is kept inline, initially zeroes.
 //
 //	"freeMap" is the bit map of free disk sectors
-//	"fileSize" is the bit map of free disk sectors
+//	"fileSize" is the size of the new file, in bytes
 //----------------------------------------------------------------------
 
 bool
 FileHeader::Allocate(PersistentBitmap *freeMap, int fileSize)
 { 
     numBytes = fileSize;
-    numSectors  = divRoundUp(fileSize, SectorSize);
-    if (freeMap->NumClear() < numSectors)
-	return FALSE;		// not enough space
-
-	if(fileSize > fileLevel4){
-		for(int i=0; fileSize > 0 && i < NumDirect; i++){
-			dataSectors[i] = freeMap->FindAndSet();
-			FileHeader* nextHDR = new FileHeader;
-			if(fileSize > fileLevel4){
-				nextHDR->Allocate(freeMap, fileLevel4);
-			}
-			else{
-				nextHDR->Allocate(freeMap, fileSize);
-			}
-			fileSize -= fileLevel4;
-			nextHDR->WriteBack(dataSectors[i]);
-			delete nextHDR;
-		}
+    numSectors = 0;
+    mapVersion++;
+    if (fileSize <= MaxInlineBytes) {
+	memset(dataSectors, 0, sizeof(dataSectors));
+	return TRUE;
+    }
+    if (divRoundUp(fileSize, SectorSize) > (int) MaxFileSectors)
+	return FALSE;			// file too big
+    memset(dataSectors, -1, sizeof(dataSectors));
+    numSectors = divRoundUp(fileSize, SectorSize);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Extend
+// 	Make the file "fileSize" bytes long, if it is shorter.  The index
+//	is made to map "chunk" sectors at a time, so that a file growing
+//	by small writes does not change its index on every one of them;
+//	the new sectors are holes until they are written.  Growing the
+//	index may take new index blocks, when the file needs another
+//	level; if the disk is too full for them, return FALSE.  An
+//	inline file stays inline as long as it fits.
+//
+//	Only index blocks below this header are written to disk; the
+//	caller must write back the header itself, and the free map.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"fileSize" is the new length of the file, in bytes
+//	"chunk" is the unit of growth, in sectors
+//----------------------------------------------------------------------
+
+bool
+FileHeader::Extend(PersistentBitmap *freeMap, int fileSize, int chunk)
+{
+    int sectors = divRoundUp(fileSize, SectorSize);
+    int target = min(divRoundUp(sectors, chunk) * chunk, (int) MaxFileSectors);
+
+    if (fileSize <= numBytes)
+	return TRUE;			// already long enough
+    if (IsInline() && fileSize > MaxInlineBytes) {
+	if (!Uninline(freeMap, sectors, target))
+	    return FALSE;		// no space on disk
+    } else if (!IsInline() && sectors > numSectors 
+		&& !Resize(freeMap, target) && !Resize(freeMap, sectors))
+	return FALSE;			// no space on disk
+    DEBUG(dbgFile, "Extending file from " << numBytes << " to " << fileSize << " bytes");
+    numBytes = fileSize;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Uninline
+// 	Make an inline file map "target" sectors, or failing that just
+//	"sectors", and move its contents out to the first of them.
+//	Return FALSE, with the file still inline, if that does not fit.
+//----------------------------------------------------------------------
+
+bool
+FileHeader::Uninline(PersistentBitmap *freeMap, int sectors, int target)
+{
+    char data[SectorSize];
+
+    memset(data, 0, SectorSize);
+    bcopy((char *) dataSectors, data, numBytes);
+    memset(dataSectors, -1, sizeof(dataSectors));
+    if ((!Resize(freeMap, target) && !Resize(freeMap, sectors)) 
+		|| !Fill(freeMap, 0, 1)) {
+	numSectors = 0;
+	memset(dataSectors, 0, sizeof(dataSectors));
+	bcopy(data, (char *) dataSectors, numBytes);
+	return FALSE;
+    }
+    DEBUG(dbgFile, "Moving " << numBytes << " inline bytes to sector " << ByteToSector(0));
+    kernel->synchDisk->WriteSector(ByteToSector(0), data);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::IsEmpty
+// 	Return TRUE if every entry of this header is a hole.
+//----------------------------------------------------------------------
+
+bool
+FileHeader::IsEmpty()
+{
+    int span = SpanOf(numSectors);
+    int entries = (span == 0) ? numSectors : divRoundUp(numSectors, span);
+
+    for (int i = 0; i < entries; i++)
+	if (dataSectors[i] != -1)
+	    return FALSE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Resize
+// 	Make the index map "sectors" file sectors in all, the new ones
+//	being holes.  Return FALSE, with nothing changed, if the file
+//	would be too big, or there is no room for the index blocks.
+//----------------------------------------------------------------------
+
+bool
+FileHeader::Resize(PersistentBitmap *freeMap, int sectors)
+{
+    int total;
+
+    if (sectors > (int) MaxFileSectors)
+	return FALSE;			// file too big
+    total = ResizeCost(sectors);
+    if (freeMap->NumClear() < total)
+	return FALSE;			// not enough space
+
+    ExtentAllocator extents(freeMap, total);
+    ResizeFrom(&extents, sectors);
+    mapVersion++;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ResizeCost
+// 	Return how many new index blocks ResizeFrom needs to make this
+//	header map "sectors" file sectors.  Only sectors already
+//	allocated need them: what is pushed down a level when the tree
+//	gets deeper, and the last child if it is allocated and grows.
+//----------------------------------------------------------------------
+
+int
+FileHeader::ResizeCost(int sectors)
+{
+    int span = SpanOf(sectors);
+    int last, total = 0;
+    FileHeader *child;
+
+    if (span == 0 || IsEmpty())
+	return 0;
+    child = new FileHeader;
+    if (SpanOf(numSectors) != span) {	// pushed down into a new child
+	child->numSectors = numSectors;
+	bcopy((char *) dataSectors, (char *) child->dataSectors, 
+			sizeof(dataSectors));
+	total = 1 + child->ResizeCost(min(sectors, span));
+    } else {
+	last = (numSectors - 1) / span;
+	if (dataSectors[last] != -1) {
+	    child->FetchFrom(dataSectors[last]);
+	    total = child->ResizeCost(min(sectors - last * span, span));
 	}
-	else if(fileSize > fileLevel3){
-		for(int i=0; fileSize > 0 && i < NumDirect; i++){
-			dataSectors[i] = freeMap->FindAndSet();
-			FileHeader* nextHDR = new FileHeader;
-			if(fileSize > fileLevel3){
-				nextHDR->Allocate(freeMap, fileLevel3);
-			}
-			else{
-				nextHDR->Allocate(freeMap, fileSize);
-			}
-			fileSize -= fileLevel3;
-			nextHDR->WriteBack(dataSectors[i]);
-			delete nextHDR;
+    }
+    delete child;
+    return total;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ResizeFrom
+// 	Grow the part of the file mapped by this header from numSectors
+//	to "sectors" file sectors, taking any new index blocks from
+//	"extents".  Index blocks below this header are written to disk
+//	as they are built or changed.
+//
+//	If the larger file needs more levels of index, whatever this
+//	header maps now is pushed down into a new index block, which
+//	becomes its first child; the data sectors themselves stay put.
+//	If nothing is mapped yet, the whole header simply stays a hole.
+//----------------------------------------------------------------------
+
+void
+FileHeader::ResizeFrom(ExtentAllocator *extents, int sectors)
+{
+	int span = SpanOf(sectors);
+	int i, last, want;
+	FileHeader *child;
+
+	if (span == 0) {
+		for (i = numSectors; i < sectors; i++)
+			dataSectors[i] = -1;
+		numSectors = sectors;
+		return;
+	}
+
+	if (SpanOf(numSectors) != span) {	// the tree gets deeper
+		if (!IsEmpty()) {
+			child = new FileHeader;
+			child->numSectors = numSectors;
+			bcopy((char *) dataSectors, (char *) child->dataSectors, 
+					sizeof(dataSectors));
+			memset(dataSectors, -1, sizeof(dataSectors));
+			dataSectors[0] = extents->Next();
+			want = min(sectors, span);
+			child->ResizeFrom(extents, want);
+			child->numBytes = want * SectorSize;
+			child->WriteBack(dataSectors[0]);
+			delete child;
+		} else
+			memset(dataSectors, -1, sizeof(dataSectors));
+	} else {
+		last = (numSectors - 1) / span;
+		want = min(sectors - last * span, span);
+		if (dataSectors[last] != -1 && want > numSectors - last * span) {
+			child = new FileHeader;	// the last child grows
+			child->FetchFrom(dataSectors[last]);
+			child->ResizeFrom(extents, want);
+			child->numBytes = want * SectorSize;
+			child->WriteBack(dataSectors[last]);
+			delete child;
 		}
+		for (i = last + 1; i * span < sectors; i++)
+			dataSectors[i] = -1;
 	}
-	else if(fileSize > fileLevel2){
-		for(int i=0; fileSize > 0 && i < NumDirect; i++){
-			dataSectors[i] = freeMap->FindAndSet();
-			FileHeader* nextHDR = new FileHeader;
-			if(fileSize > fileLevel2){
-				nextHDR->Allocate(freeMap, fileLevel2);
-			}
-			else{
-				nextHDR->Allocate(freeMap, fileSize);
+	numSectors = sectors;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Fill
+// 	Allocate the holes among the "count" file sectors starting at
+//	"first", along with whatever index blocks they need, so that
+//	they can be written.  Return FALSE, with nothing changed, if there
+//	is not enough free space.
+//
+//	The new sectors are placed in as few contiguous runs as the free
+//	map allows (see ExtentAllocator).  Index blocks below this header
+//	are written to disk; the caller must write back the header
+//	itself, and the free map.  Newly allocated data sectors hold
+//	garbage until the caller writes them.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"first" is the first file sector to allocate
+//	"count" is the number of file sectors
+//----------------------------------------------------------------------
+
+bool
+FileHeader::Fill(PersistentBitmap *freeMap, int first, int count)
+{
+    int total;
+
+    count = min(first + count, numSectors) - first;
+    if (count <= 0)
+	return TRUE;			// nothing mapped there
+    total = FillCost(first, count);
+    if (total == 0)
+	return TRUE;			// no holes
+    if (freeMap->NumClear() < total)
+	return FALSE;			// not enough space
+
+    DEBUG(dbgFile, "Filling " << total << " sectors for file sectors " << first << " to " << first + count - 1);
+    ExtentAllocator extents(freeMap, total);
+    FillFrom(&extents, first, count);
+    mapVersion++;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::FillCost
+// 	Return the number of sectors, data plus index, that Fill needs
+//	to allocate the holes among "count" file sectors from "first".
+//----------------------------------------------------------------------
+
+int
+FileHeader::FillCost(int first, int count)
+{
+    int span = SpanOf(numSectors);
+    int i, lo, hi, total = 0;
+    FileHeader *child;
+
+    if (span == 0) {
+	for (i = first; i < first + count; i++)
+	    if (dataSectors[i] == -1)
+		total++;
+	return total;
+    }
+    for (i = first / span; i * span < first + count; i++) {
+	lo = max(first, i * span) - i * span;
+	hi = min(first + count, (i + 1) * span) - i * span;
+	if (dataSectors[i] == -1)
+	    total += 1 + HoleCost(min(numSectors - i * span, span), lo, hi - lo);
+	else {
+	    child = new FileHeader;
+	    child->FetchFrom(dataSectors[i]);
+	    total += child->FillCost(lo, hi - lo);
+	    delete child;
+	}
+    }
+    return total;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::FillFrom
+// 	Allocate the holes among "count" file sectors from "first",
+//	taking the sectors from "extents" in order, so that each new
+//	index block sits in front of the data it maps.  Return the number
+//	of sectors allocated.
+//----------------------------------------------------------------------
+
+int
+FileHeader::FillFrom(ExtentAllocator *extents, int first, int count)
+{
+	int span = SpanOf(numSectors);
+	int i, lo, hi, filled = 0, n;
+	FileHeader *child;
+
+	if (span == 0) {
+		for (i = first; i < first + count; i++)
+			if (dataSectors[i] == -1) {
+				dataSectors[i] = extents->Next();
+				filled++;
 			}
-			fileSize -= fileLevel2;
-			nextHDR->WriteBack(dataSectors[i]);
-			delete nextHDR;
-		}
+		return filled;
 	}
-	else{
-		for (int i = 0; i < numSectors; i++) {
-			dataSectors[i] = freeMap->FindAndSet();
-			// since we checked that there was enough free space,
-			// we expect this to succeed
-			ASSERT(dataSectors[i] >= 0);
-		}
+	for (i = first / span; i * span < first + count; i++) {
+		lo = max(first, i * span) - i * span;
+		hi = min(first + count, (i + 1) * span) - i * span;
+		child = new FileHeader;
+		if (dataSectors[i] == -1) {	// a hole becomes an index block
+			dataSectors[i] = extents->Next();
+			child->numSectors = min(numSectors - i * span, span);
+			child->numBytes = child->numSectors * SectorSize;
+			filled++;
+		} else
+			child->FetchFrom(dataSectors[i]);
+		n = child->FillFrom(extents, lo, hi - lo);
+		if (n > 0)
+			child->WriteBack(dataSectors[i]);
+		filled += n;
+		delete child;
 	}
-    
-    return TRUE;
+	return filled;
 }
 
 //----------------------------------------------------------------------
 // FileHeader::Deallocate
-// 	De-allocate all the space allocated for data blocks for this file.
+// 	De-allocate all the space allocated for data blocks for this file,
+//	and for the index blocks below this header.  Holes have nothing
+//	to give back.
 //
 //	"freeMap" is the bit map of free disk sectors
 //----------------------------------------------------------------------
@@ -146,17 +529,25 @@ FileHeader::Allocate(PersistentBitmap *freeMap, int fileSize)
 void 
 FileHeader::Deallocate(PersistentBitmap *freeMap)
 {
-	if(numBytes > fileLevel2){
+	int span = SpanOf(numSectors);
+
+	if(span != 0){
 		FileHeader* nextHDR;
-		for(int i=0; i< divRoundUp(numSectors, NumDirect);i++){
+		for(int i=0; i * span < numSectors;i++){
+			if (dataSectors[i] == -1)
+				continue;		// a hole
 			nextHDR = new FileHeader;
 			nextHDR->FetchFrom(dataSectors[i]);
 			nextHDR->Deallocate(freeMap);
 			delete nextHDR;
+			ASSERT(freeMap->Test((int) dataSectors[i]));  // ought to be marked!
+			freeMap->Clear((int) dataSectors[i]);	// the index block
 		}
 	}
 	else{
 		for (int i = 0; i < numSectors; i++) {
+			if (dataSectors[i] == -1)
+				continue;		// a hole
 			ASSERT(freeMap->Test((int) dataSectors[i]));  // ought to be marked!
 			freeMap->Clear((int) dataSectors[i]);
 		}
@@ -164,6 +555,39 @@ FileHeader::Deallocate(PersistentBitmap *freeMap)
     
 }
 
+//----------------------------------------------------------------------
+// FileHeader::DeallocateTop
+// 	De-allocate one level of the file: the data sectors this header
+//	maps directly, if it is a leaf of the index.  Otherwise copy the
+//	index blocks right below it (leaving out holes) into "children"
+//	and return how many there are; the caller deallocates each of
+//	them the same way, and then the sector it read it from, so that
+//	a big file can be freed a bit at a time.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"children" must have room for NumDirect entries
+//----------------------------------------------------------------------
+
+int
+FileHeader::DeallocateTop(PersistentBitmap *freeMap, int *children)
+{
+    int span = SpanOf(numSectors);
+    int i, count = 0;
+
+    if (span == 0) {
+	for (i = 0; i < numSectors; i++)
+	    if (dataSectors[i] != -1) {
+		ASSERT(freeMap->Test(dataSectors[i]));	// ought to be marked!
+		freeMap->Clear(dataSectors[i]);
+	    }
+	return 0;
+    }
+    for (i = 0; i * span < numSectors; i++)
+	if (dataSectors[i] != -1)
+	    children[count++] = dataSectors[i];
+    return count;
+}
+
 //----------------------------------------------------------------------
 // FileHeader::FetchFrom
 // 	Fetch contents of file header from disk. 
@@ -213,40 +637,91 @@ FileHeader::WriteBack(int sector)
 //	offset in the file) to a physical address (the sector where the
 //	data at the offset is stored).
 //
+//	Return -1 if the byte lies in a hole.
+//
 //	"offset" is the location within the file of the byte in question
 //----------------------------------------------------------------------
 
 int
 FileHeader::ByteToSector(int offset)
 {
-	int sector = -1;
-	FileHeader* nextHDR = new FileHeader;
-	if(numBytes > fileLevel4){
-		//DEBUG(dbgFile, "ByteToSector4");
-		sector = divRoundDown(offset, fileLevel4);
-		nextHDR -> FetchFrom(dataSectors[sector]);
-		sector = nextHDR->ByteToSector(offset - sector * fileLevel4);
-	}
-	else if(numBytes > fileLevel3){
-		//DEBUG(dbgFile, "ByteToSector3");
-		sector = divRoundDown(offset, fileLevel3);
-		nextHDR -> FetchFrom(dataSectors[sector]);
-		sector = nextHDR->ByteToSector(offset - sector * fileLevel3);
-	}
-	else if(numBytes > fileLevel2){
-		//DEBUG(dbgFile, "ByteToSector2");
-		sector = divRoundDown(offset, fileLevel2);
-		
-		nextHDR -> FetchFrom(dataSectors[sector]);
-		sector = nextHDR->ByteToSector(offset - sector * fileLevel2);
-	}
-	else{
-		//DEBUG(dbgFile, "ByteToSector1");
-		sector = dataSectors[offset / SectorSize];
-	}
-	//DEBUG(dbgFile, "leave ByteToSector");
+	int span = SpanOf(numSectors) * SectorSize;
+	int child, sector;
+	FileHeader* nextHDR;
+
+	if(span == 0)
+		return dataSectors[offset / SectorSize];
+
+	child = divRoundDown(offset, span);
+	if (dataSectors[child] == -1)
+		return -1;		// a hole
+	nextHDR = new FileHeader;
+	nextHDR -> FetchFrom(dataSectors[child]);
+	sector = nextHDR->ByteToSector(offset - child * span);
 	delete nextHDR;
-    return sector;
+	return sector;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::LeafSectors
+// 	Find the bottom-level index block (the one holding data sector
+//	numbers) that covers a byte offset, and copy its table of data
+//	sectors into "sectors".  Return how many entries were copied.
+//
+//	Every leaf maps NumDirect consecutive sectors of the file, so
+//	the leaf covering "offset" maps the sectors starting at
+//	divRoundDown(offset, fileLevel2) * NumDirect.  This lets a caller
+//	resolve a whole run of sectors with one walk down the index.
+//	Holes come out as -1, as does every entry of a leaf that lies
+//	entirely in a hole.
+//
+//	"offset" is a byte offset within the file
+//	"sectors" must have room for NumDirect entries
+//----------------------------------------------------------------------
+
+int
+FileHeader::LeafSectors(int offset, int *sectors)
+{
+	int span = SpanOf(numSectors) * SectorSize;
+	int child, count;
+	FileHeader *nextHDR;
+
+	if(span != 0){
+		child = divRoundDown(offset, span);
+		if (dataSectors[child] == -1) {	// a hole
+			for (int i = 0; i < (int) NumDirect; i++)
+				sectors[i] = -1;
+			return NumDirect;
+		}
+		nextHDR = new FileHeader;
+		nextHDR->FetchFrom(dataSectors[child]);
+		count = nextHDR->LeafSectors(offset - child * span, sectors);
+		delete nextHDR;
+		return count;
+	}
+	for (int i = 0; i < numSectors; i++)
+		sectors[i] = dataSectors[i];
+	return numSectors;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ReadInline/WriteInline
+// 	Copy part of the contents of an inline file out of, or into, the
+//	header.  The range must lie within the file.
+//----------------------------------------------------------------------
+
+void
+FileHeader::ReadInline(char *into, int numBytes, int position)
+{
+    ASSERT(IsInline() && position >= 0 && position + numBytes <= this->numBytes);
+    bcopy((char *) dataSectors + position, into, numBytes);
+}
+
+void
+FileHeader::WriteInline(char *from, int numBytes, int position)
+{
+    ASSERT(IsInline() && position >= 0 && position + numBytes <= this->numBytes);
+    bcopy(from, (char *) dataSectors + position, numBytes);
 }
 
 //----------------------------------------------------------------------
@@ -269,14 +744,20 @@ FileHeader::FileLength()
 void
 FileHeader::Print()
 {
+	int span = SpanOf(numSectors);
+
 	printf("FileHeader contents.  File size: %d.  File blocks:\n", numBytes);
-	if(numBytes > fileLevel2){
-		OpenFile* openfile;
-		for(int i=0; i<numSectors / NumDirect && i < NumDirect; i++){
-			openfile = new OpenFile(dataSectors[i]);
-			FileHeader *nextHDR = openfile->get_hdr();
+	if(span != 0){
+		FileHeader *nextHDR = new FileHeader;
+		for(int i=0; i * span < numSectors; i++){
+			if (dataSectors[i] == -1) {
+				printf("Hole of %d sectors\n", min(numSectors - i * span, span));
+				continue;
+			}
+			nextHDR->FetchFrom(dataSectors[i]);
 			nextHDR->Print();
 		}
+		delete nextHDR;
 	}
 	else{
 		int i, j, k;
@@ -284,9 +765,16 @@ FileHeader::Print()
 		
 		for (i = 0; i < numSectors; i++)
 			printf("%d ", dataSectors[i]);
+		if (IsInline())
+			printf("(inline)");
 		printf("\nFile contents:\n");
-		for (i = k = 0; i < numSectors; i++) {
-			kernel->synchDisk->ReadSector(dataSectors[i], data);
+		for (i = k = 0; i < max(numSectors, 1); i++) {
+			if (IsInline())
+				ReadInline(data, numBytes, 0);
+			else if (dataSectors[i] == -1)
+				memset(data, 0, SectorSize);	// a hole
+			else
+				kernel->synchDisk->ReadSector(dataSectors[i], data);
 			for (j = 0; (j < SectorSize) && (k < numBytes); j++, k++) {
 				if ('\040' <= data[j] && data[j] <= '\176')   // isprint(data[j])
 					printf("%c", data[j]);
@@ -316,24 +804,29 @@ FileHeader::self_Print(){
 			printf("%d ", dataSectors[i]);
 		
 	}*/
+	int capacity = numSectors * SectorSize;	// the index follows this
+
 	printf("FileHeader contents.  File size: %d.\n", numBytes);
-	if(numBytes > fileLevel4){
+	if(capacity > fileLevel4){
 		printf("This file has 4 level structure, ");
 		int level = 1+ 30 + 30*30 + 1;
 		printf("it use at least %d sectors for file header.\n", level);
 	}
-	else if(numBytes > fileLevel3){
+	else if(capacity > fileLevel3){
 		printf("This file has 3 level structure, ");
 		int level = 1+30 + 1;
-		level = level + divRoundUp((numBytes - fileLevel3), 120);
+		level = level + divRoundUp((capacity - fileLevel3), 120);
 		printf("it use at least %d sectors for file header.\n", level);
 	}
-	else if(numBytes > fileLevel2){
+	else if(capacity > fileLevel2){
 		printf("This file has 2 level structure, ");
 		int level = 2;
 		
 		printf("it use at least %d sectors for file header.\n", level);
 	}
+	else if(IsInline()){
+		printf("This file is stored inline, in its file header sector");
+	}
 	else{
 		printf("This file has 1 level structure, use only one sector for file header");
 	}
@@ -17,8 +17,11 @@
 #include "disk.h"
 #include "pbitmap.h"
 
+class ExtentAllocator;
+
 #define NumDirect 	((SectorSize - 2 * sizeof(int)) / sizeof(int))
 #define MaxFileSize 	(NumDirect * SectorSize)
+#define MaxInlineBytes 	((int) (NumDirect * sizeof(int)))
 
 // The following class defines the Nachos "file header" (in UNIX terms,  
 // the "i-node"), describing where on disk to find all of the data in the file.
@@ -31,6 +34,14 @@
 // as one disk sector.  Without indirect addressing, this
 // limits the maximum file length to just under 4K bytes.
 //
+// A file of at most MaxInlineBytes that has no data sectors keeps its
+// contents in the header itself, in place of the sector table, so it
+// can be read with a single disk access.  Once it grows past that, the
+// contents move out to a data sector and the header becomes an index.
+//
+// Files are sparse: an index entry of -1 is a hole, which reads as
+// zeroes and takes no disk space until it is written.
+//
 // There is no constructor; rather the file header can be initialized
 // by allocating blocks for the file (if it is a new file), or by
 // reading it from disk.
@@ -42,10 +53,22 @@ class FileHeader {
 	~FileHeader();
 	
     bool Allocate(PersistentBitmap *bitMap, int fileSize);// Initialize a file header, 
-						//  including allocating space 
-						//  on disk for the file data
+						//  with the whole file a hole
+    bool Extend(PersistentBitmap *bitMap, int fileSize, int chunk);
+						// Grow the file to "fileSize"
+						//  bytes, mapping sectors in
+						//  multiples of "chunk"
+    bool Fill(PersistentBitmap *bitMap, int first, int count);
+						// Allocate the holes among
+						//  "count" file sectors from
+						//  "first"
     void Deallocate(PersistentBitmap *bitMap);  // De-allocate this file's 
 						//  data blocks
+    int DeallocateTop(PersistentBitmap *bitMap, int *children);
+						// De-allocate just the data
+						//  blocks this header maps
+						//  itself, and return the index
+						//  blocks below it
 
     void FetchFrom(int sectorNumber); 	// Initialize file header from disk
     void WriteBack(int sectorNumber); 	// Write modifications to file header
@@ -53,15 +76,46 @@ class FileHeader {
 
     int ByteToSector(int offset);	// Convert a byte offset into the file
 					// to the disk sector containing
-					// the byte
+					// the byte, or -1 for a hole
+    int LeafSectors(int offset, int *sectors);
+					// Copy out the data sectors of the
+					// index block covering "offset"
 
     int FileLength();			// Return the length of the file 
 					// in bytes
+    int AllocatedSectors() { return numSectors; }
+					// Return the number of file sectors
+					// the index maps, some perhaps past
+					// the end of the file, or holes
+    int MapVersion() { return mapVersion; }
+					// Changes whenever the index does
+    bool IsInline() { return numSectors == 0; }
+					// Is the data kept in the header?
+    void ReadInline(char *into, int numBytes, int position);
+    void WriteInline(char *from, int numBytes, int position);
+					// Copy bytes of an inline file out
+					//  of/into the header; the caller
+					//  writes the header back
 
     void Print();			// Print the contents of the file.
 	void self_Print();
 
   private:
+    bool Resize(PersistentBitmap *bitMap, int sectors);
+					// Map "sectors" file sectors, the
+					// new ones holes, if there is room
+    int ResizeCost(int sectors);	// # of index blocks Resize takes
+    void ResizeFrom(ExtentAllocator *extents, int sectors);
+					// Resize, taking new index blocks
+					// from "extents"
+    int FillCost(int first, int count);	// # of sectors Fill takes
+    int FillFrom(ExtentAllocator *extents, int first, int count);
+					// Fill, taking the new sectors from
+					// a run of contiguous free sectors
+    bool IsEmpty();			// Is every entry a hole?
+    bool Uninline(PersistentBitmap *bitMap, int sectors, int target);
+					// Move inline data out to data
+					//  sectors
 	
 	/*
 		MP4 hint:
@@ -74,14 +128,22 @@ class FileHeader {
 		
 		Disk Part - numBytes, numSectors, dataSectors occupy exactly 128 bytes and will be
 		written to a sector on disk.
-		In-core part - none
+		In-core part - mapVersion
 		
 	*/
 	
     int numBytes;			// Number of bytes in the file
-    int numSectors;			// Number of data sectors in the file
+    int numSectors;			// Number of data sectors allocated;
+					// this, not numBytes, decides how
+					// many levels of index there are
     int dataSectors[NumDirect];		// Disk sector numbers for each data 
-					// block in the file
+					// block in the file (-1 for a hole),
+					// or the data itself if numSectors
+					// is 0
+
+    int mapVersion;			// In-core only: bumped whenever
+					// sectors are mapped, so OpenFiles
+					// know to forget what they cached
 };
 
 #endif // FILEHDR_H
@@ -21,23 +21,33 @@
 //	The file system assumes that the bitmap and directory files are
 //	kept "open" continuously while Nachos is running.
 //
+//	The bitmap is read in once, when the file system is mounted, and
+//	stays in memory.  It keeps track of which of its sectors have
+//	changed, and only those are written back.
+//
 //	For those operations (such as Create, Remove) that modify the
 //	directory and/or bitmap, if the operation succeeds, the changes
 //	are written immediately back to disk (the two files are kept
-//	open during all this time).  If the operation fails, and we have
-//	modified part of the directory and/or bitmap, we simply discard
-//	the changed version, without writing it back to disk.
+//	open during all this time).  A directory writes each sector of
+//	itself as it changes it, and is changed last, once nothing else
+//	can fail; if the operation fails, sectors already taken from the
+//	bitmap are given back to it.
+//
+//	Each such operation is a transaction of the journal (cf. the
+//	Journal class in synchdisk.h), so that its changes to headers,
+//	directories and the bitmap reach the disk all together or not at
+//	all.  The log lives in a fixed region after the two well-known
+//	headers, and is replayed when the file system is mounted.  The
+//	contents of ordinary files are not journaled.
+//
+//	Removing a file only takes its name out of the directory; its
+//	header and blocks are freed afterwards by a kernel thread, one
+//	index block at a time, so that removing even a huge file takes
+//	no longer than removing a small one.
 //
 // 	Our implementation at this point has the following restrictions:
 //
 //	   there is no synchronization for concurrent accesses
-//	   files have a fixed size, set when the file is created
-//	   files cannot be bigger than about 3KB in size
-//	   there is no hierarchical directory structure, and only a limited
-//	     number of files can be added to the system
-//	   there is no attempt to make the system robust to failures
-//	    (if Nachos exits in the middle of an operation that modifies
-//	    the file system, it may corrupt the disk)
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -48,9 +58,12 @@
 #include "debug.h"
 #include "disk.h"
 #include "pbitmap.h"
+#include "synchdisk.h"
 #include "directory.h"
 #include "filehdr.h"
 #include "filesys.h"
+#include "synch.h"
+#include "main.h"
 
 // Sectors containing the file headers for the bitmap of free sectors,
 // and the directory of files.  These file headers are placed in well-known 
@@ -58,13 +71,38 @@
 #define FreeMapSector 		0
 #define DirectorySector 	1
 
-// Initial file sizes for the bitmap and directory; until the file system
-// supports extensible files, the directory size sets the maximum number 
-// of files that can be loaded onto the disk.
+// The journal occupies a fixed run of sectors right after them.
+#define LogSector 		2
+#define NumLogSectors 		512
+
+// A file is grown at most this many bytes per transaction, so that
+// the header and bitmap sectors it changes fit in one journal record.
+#define MaxExtendBytes 		(256 * SectorSize)
+
+// Holes are given space this many sectors at a time.  One piece logs
+// at most a bitmap sector for each of its data sectors, and for each
+// of up to 6 index blocks (two leaves, and what is above them, in the
+// deepest index), which are written too, and the header.
+#define FillPieceSectors	8
+#define FillPieceBlocks		(FillPieceSectors + 2 * 6 + 1)
+
+// Initial file sizes for the bitmap and directory; a directory starts
+// out as just its header, and grows as files are added to it.
 #define FreeMapFileSize 	(NumSectors / BitsInByte)
 //MP4 modified
-#define NumDirEntries 		64
-#define DirectoryFileSize 	(sizeof(DirectoryEntry) * NumDirEntries)
+#define DirectoryFileSize 	(sizeof(DirectoryHeader))
+
+//----------------------------------------------------------------------
+// ReclaimerThread
+// 	The body of the kernel thread that frees removed files; see
+//	FileSystem::Reclaimer.
+//----------------------------------------------------------------------
+
+static void
+ReclaimerThread(FileSystem *fileSystem)
+{
+    fileSystem->Reclaimer();
+}
 
 //----------------------------------------------------------------------
 // FileSystem::FileSystem
@@ -73,33 +111,48 @@
 //	an empty directory, and a bitmap of free sectors (with almost but
 //	not all of the sectors marked as free).  
 //
-//	If format = FALSE, we just have to open the files
-//	representing the bitmap and the directory.
+//	If format = FALSE, we first replay whatever the journal holds,
+//	then open the files representing the bitmap and the directory,
+//	and read in the bitmap.
 //
 //	"format" -- should we initialize the disk?
+//	"preallocSectors" -- how many sectors at a time to allocate to a
+//		file that grows
 //----------------------------------------------------------------------
 
-FileSystem::FileSystem(bool format)
+FileSystem::FileSystem(bool format, int preallocSectors)
 { 
     DEBUG(dbgFile, "Initializing the file system.");
+    ASSERT(preallocSectors > 0);
+    this->preallocSectors = preallocSectors;
+    journal = new Journal(LogSector, NumLogSectors);
     if (format) {
-        PersistentBitmap *freeMap = new PersistentBitmap(NumSectors);
-        Directory *directory = new Directory(NumDirEntries);
+        Directory *directory;
 		FileHeader *mapHdr = new FileHeader;
 		FileHeader *dirHdr = new FileHeader;
 
         DEBUG(dbgFile, "Formatting the file system.");
+        freeMap = new PersistentBitmap(NumSectors);
 
 		// First, allocate space for FileHeaders for the directory and bitmap
 		// (make sure no one else grabs these!)
 		freeMap->Mark(FreeMapSector);	    
 		freeMap->Mark(DirectorySector);
+		for (int i = 0; i < NumLogSectors; i++)
+		    freeMap->Mark(LogSector + i);
+		journal->Format();
 
 		// Second, allocate space for the data blocks containing the contents
 		// of the directory and bitmap files.  There better be enough space!
 
+		// Files start out as holes; these two are given all their space
+		// now, since writing them cannot go through the file system
+		// while it is still being built.
+
 		ASSERT(mapHdr->Allocate(freeMap, FreeMapFileSize));
+		ASSERT(mapHdr->Fill(freeMap, 0, divRoundUp(FreeMapFileSize, SectorSize)));
 		ASSERT(dirHdr->Allocate(freeMap, DirectoryFileSize));
+		ASSERT(dirHdr->Fill(freeMap, 0, divRoundUp(DirectoryFileSize, SectorSize)));
 
 		// Flush the bitmap and directory FileHeaders back to disk
 		// We need to do this before we can "Open" the file, since open
@@ -125,46 +178,379 @@ FileSystem::FileSystem(bool format)
 
         DEBUG(dbgFile, "Writing bitmap and directory back to disk.");
 		freeMap->WriteBack(freeMapFile);	 // flush changes to disk
-		directory->WriteBack(directoryFile);
+		directory = new Directory(directoryFile);
+		directory->Format();
 
 		if (debug->IsEnabled('f')) {
 			freeMap->Print();
 			directory->Print();
         }
-        delete freeMap; 
 		delete directory; 
 		delete mapHdr; 
 		delete dirHdr;
     } else {
-		// if we are not formatting the disk, just open the files representing
-		// the bitmap and directory; these are left open while Nachos is running
+		// if we are not formatting the disk, finish any operation the
+		// journal holds, then open the files representing the bitmap
+		// and directory; these are left open while Nachos is running
+		journal->Recover();
         freeMapFile = new OpenFile(FreeMapSector);
         directoryFile = new OpenFile(DirectorySector);
+        freeMap = new PersistentBitmap(freeMapFile,NumSectors);
     }
-    //MP4 modified
-    currentOpenedFile = NULL;
+    dentries = new DentryCache;
+    kernel->synchDisk->SetJournal(journal);
+
+    static char pendingName[] = "reclaim pending";
+    static char stoppedName[] = "reclaimer stopped";
+    static char reclaimerName[] = "reclaimer";
+
+    reclaimQueue = new ::List<RemovedBlock *>;
+    reclaimPending = new Semaphore(pendingName, 0);
+    reclaimStopping = FALSE;
+    reclaimStopped = new Semaphore(stoppedName, 0);
+    Thread *reclaimer = new Thread(reclaimerName, kernel->currentThread->getID());
+    reclaimer->Fork((VoidFunctionPtr) ReclaimerThread, (void *) this);
 }
 
 //----------------------------------------------------------------------
 // MP4 mod tag
 // FileSystem::~FileSystem
+//	Let the reclaimer free the rest of the removed files and stop,
+//	write back whatever part of the bitmap is still dirty, and leave
+//	the journal empty.
 //----------------------------------------------------------------------
 FileSystem::~FileSystem()
 {
+	reclaimStopping = TRUE;
+	reclaimPending->V();		// one more than there are blocks
+	reclaimStopped->P();
+	ASSERT(reclaimQueue->IsEmpty());
+	journal->Begin();
+	freeMap->WriteBack(freeMapFile);
+	journal->End();
+	journal->Checkpoint();
+	kernel->synchDisk->SetJournal(NULL);
+	delete journal;
+	delete freeMap;
 	delete freeMapFile;
 	delete directoryFile;
+	delete dentries;
+	delete reclaimQueue;
+	delete reclaimPending;
+	delete reclaimStopped;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ExtendFile
+// 	Make an open file "fileSize" bytes long, allocating its new space
+//	preallocSectors at a time, and flush the free map.  The file grows
+//	MaxExtendBytes per transaction; if the disk fills up part way, it
+//	keeps what it got.  Any new index blocks go near the end of the
+//	file.  Return FALSE if it could not grow at all.
+//	Called by OpenFile::WriteAt.
+//----------------------------------------------------------------------
+
+bool
+FileSystem::ExtendFile(OpenFile *file, int fileSize)
+{
+    int length = file->Length();
+    int size = length;
+    bool success = TRUE;
+
+    while (success && size < fileSize) {
+	size = min(fileSize, size + MaxExtendBytes);
+	journal->Begin();
+	freeMap->SetGoal(file->PlaceNear(file->get_hdr()->AllocatedSectors()));
+	success = file->Extend(freeMap, size, preallocSectors);
+	if (success)
+	    freeMap->WriteBack(freeMapFile);
+	journal->End();
+    }
+    return file->Length() > length || fileSize <= length;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FillFile
+// 	Give disk space to the holes among "count" sectors of an open
+//	file from sector "first", so that they can be written, and flush
+//	the free map.  A write that reaches the last sector of the file
+//	takes the following holes too, up to the next multiple of
+//	preallocSectors, so that a file written by small appends still
+//	lies in long runs; those sectors are past the end of the file,
+//	where nobody reads them before they are written (or zeroed by
+//	OpenFile::ZeroGap).  The space is taken near the sectors of the
+//	file before "first" (see OpenFile::PlaceNear).
+//
+//	The holes are filled FillPieceSectors at a time, and each
+//	transaction takes as many pieces as are sure to fit in
+//	MaxTransactionBlocks, so that filling a big write does not
+//	overflow the journal.  If the disk fills up part way, the file
+//	keeps what it got.  Return how many of the "count" sectors have
+//	space now -- all of them, or as many from "first" on as there
+//	was room for.
+//	Called by OpenFile::WriteAt.
+//----------------------------------------------------------------------
+
+int
+FileSystem::FillFile(OpenFile *file, int first, int count)
+{
+    int start = first, want = first + count, end = want;
+    int mapped = file->get_hdr()->AllocatedSectors();
+    int piece;
+    bool full = FALSE;
+
+    if (end >= divRoundUp(file->Length(), SectorSize))
+	end = min(divRoundUp(end, preallocSectors) * preallocSectors, mapped);
+    while (!full && first < end) {
+	journal->Begin();
+	do {
+	    piece = min(end - first, FillPieceSectors);
+	    freeMap->SetGoal(file->PlaceNear(first));
+	    if (file->Fill(freeMap, first, piece))
+		first += piece;
+	    else if (end > want)
+		end = max(want, first);	// do without the extra sectors
+	    else
+		full = TRUE;		// no room
+	} while (!full && first < end && journal->Logged() 
+		+ freeMap->NumDirty() + FillPieceBlocks <= MaxTransactionBlocks);
+	freeMap->WriteBack(freeMapFile);
+	journal->End();
+    }
+    return min(first, want) - start;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::RoomLeft
+// 	Return how many more sectors the current transaction may log,
+//	counting the bitmap sectors it has changed but not written back
+//	yet.  Called by Directory::Split.
+//----------------------------------------------------------------------
+
+int
+FileSystem::RoomLeft()
+{
+    return MaxTransactionBlocks - journal->Logged() - freeMap->NumDirty();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Reclaim
+// 	Give back the header and data sectors of a removed file, once it
+//	is out of its directory and nobody has it open.  The work is
+//	queued for the reclaimer thread, so this returns right away.
+//	Called by Remove, and by OpenFileTable::Release for a file that
+//	was removed while it was open.
+//
+//	Along with the block goes a ticket for every change logged so
+//	far, which includes taking the file out of its directory; the
+//	space is not freed before that is committed.
+//
+//	"sector" -- the location on disk of the file's header
+//----------------------------------------------------------------------
+
+void
+FileSystem::Reclaim(int sector)
+{
+    RemovedBlock *block = new RemovedBlock;
+
+    DEBUG(dbgFile, "Queueing removed file at sector " << sector << " for reclaiming");
+    block->sector = sector;
+    block->ticket = journal->Ticket();
+    reclaimQueue->Append(block);
+    reclaimPending->V();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ReclaimStep
+// 	Free one block of a removed file's index: the header or index
+//	block at the front of the queue, along with the data sectors it
+//	maps directly.  The index blocks below it go to the back of the
+//	queue, for later steps.
+//
+//	Nothing is freed until the removal of the file has been
+//	committed: otherwise, after a crash, the file could be back in
+//	its directory with its space given to another file.  Each step
+//	is then a transaction of its own, writing back the bitmap, so
+//	that no sector is free on disk before it is free in the log.  A
+//	crash between steps leaves the rest of the file allocated to no
+//	file -- lost space, but nothing worse.
+//
+//	The block is read before anything is changed, since waiting and
+//	reading may let other threads run; it stays at the front of the
+//	queue until then, so that it cannot get lost.  The bits of one
+//	block, NumDirect data sectors and itself, fit in one transaction.
+//----------------------------------------------------------------------
+
+void
+FileSystem::ReclaimStep()
+{
+    FileHeader *hdr = new FileHeader;
+    int children[NumDirect];
+    RemovedBlock *block;
+    int count;
+
+    block = reclaimQueue->Front();
+    journal->WaitCommitted(block->ticket);
+    hdr->FetchFrom(block->sector);
+    ASSERT(reclaimQueue->Front() == block);
+    reclaimQueue->RemoveFront();
+
+    journal->Begin();
+    count = hdr->DeallocateTop(freeMap, children);
+    for (int i = 0; i < count; i++)
+	Reclaim(children[i]);
+    ASSERT(freeMap->Test(block->sector));	// ought to be marked!
+    freeMap->Clear(block->sector);
+    freeMap->WriteBack(freeMapFile);
+    journal->End();
+    DEBUG(dbgFile, "Reclaimed index block " << block->sector << ", " << freeMap->NumClear() << " sectors free");
+    delete block;
+    delete hdr;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Reclaimer
+// 	Free removed files until the file system goes away.  Run by a
+//	kernel thread of its own, which sleeps until some block is
+//	queued, and gives up the CPU after each one, so that it never
+//	holds up anybody for long.  It is the only thread that frees
+//	blocks: the destructor asks it to stop by signalling
+//	reclaimPending once more than there are blocks, so that the
+//	queue runs empty with a signal left over, and waits until it has.
+//----------------------------------------------------------------------
+
+void
+FileSystem::Reclaimer()
+{
+    for (;;) {
+	reclaimPending->P();
+	if (reclaimQueue->IsEmpty())
+	    break;			// only the request to stop was left
+	ReclaimStep();
+	kernel->currentThread->Yield();
+    }
+    ASSERT(reclaimStopping);
+    reclaimStopped->V();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::OpenDirectory/CloseDirectory
+// 	Open the directory whose header is at "sector", and close it
+//	again.  The root directory is always open already, and is simply
+//	handed out.
+//----------------------------------------------------------------------
+
+OpenFile *
+FileSystem::OpenDirectory(int sector)
+{
+    if (sector == DirectorySector)
+	return directoryFile;
+    return new OpenFile(sector);
+}
+
+void
+FileSystem::CloseDirectory(OpenFile *file)
+{
+    if (file != directoryFile)
+	delete file;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::LookupIn
+// 	Return the header sector of "name" in the directory whose header
+//	is at "dirSector", or -1 if there is no such name, and set
+//	"*isFile" to whether it is a file or a directory.  The dentry
+//	cache is consulted first; only on a miss is the directory read.
+//----------------------------------------------------------------------
+
+int
+FileSystem::LookupIn(int dirSector, char *name, bool *isFile)
+{
+    Directory *directory;
+    OpenFile *dirFile;
+    int sector;
+
+    if (dentries->Lookup(dirSector, name, &sector, isFile)) {
+	kernel->stats->numDentryHits++;
+	return sector;
+    }
+    kernel->stats->numDentryMisses++;
+
+    dirFile = OpenDirectory(dirSector);
+    directory = new Directory(dirFile);
+    sector = directory->Find(name);
+    *isFile = (sector != -1) && directory->IsFile(name);
+    dentries->Enter(dirSector, name, sector, *isFile);
+    delete directory;
+    CloseDirectory(dirFile);
+    return sector;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Resolve
+// 	Walk an absolute path down from the root directory.  Return the
+//	header sector of the directory holding the last component of
+//	"path", and point "*leaf" at that component (NULL if the path
+//	names the root itself).  Return -1 if one of the directories
+//	along the way does not exist, or is a file.
+//
+//	"path" is broken up in place, with strtok.
+//----------------------------------------------------------------------
+
+int
+FileSystem::Resolve(char *path, char **leaf)
+{
+    int dirSector = DirectorySector;
+    char *token = strtok(path, "/");
+    char *next;
+    bool isFile;
+
+    *leaf = NULL;
+    while (token != NULL) {
+	next = strtok(NULL, "/");
+	if (next == NULL) {
+	    *leaf = token;
+	    break;
+	}
+	dirSector = LookupIn(dirSector, token, &isFile);
+	if (dirSector == -1 || isFile) {
+	    DEBUG(dbgFile, "No directory " << token << " on the path");
+	    return -1;
+	}
+	token = next;
+    }
+    return dirSector;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ResolveAll
+// 	Return the header sector of whatever "path" names, or -1 if it
+//	does not exist, and set "*isFile" to its type.
+//----------------------------------------------------------------------
+
+int
+FileSystem::ResolveAll(char *path, bool *isFile)
+{
+    char *leaf;
+    int dirSector = Resolve(path, &leaf);
+
+    *isFile = FALSE;
+    if (dirSector == -1 || leaf == NULL)
+	return dirSector;		// not found, or the root
+    return LookupIn(dirSector, leaf, isFile);
 }
 
 //----------------------------------------------------------------------
 // FileSystem::Create
 // 	Create a file in the Nachos file system (similar to UNIX create).
-//	Since we can't increase the size of files dynamically, we have
-//	to give Create the initial size of the file.
+//	The file is given an initial size; it grows later, as it is
+//	written past its end.
 //
 //	The steps to create a file are:
 //	  Make sure the file doesn't already exist
-//        Allocate a sector for the file header
-// 	  Allocate space on disk for the data blocks for the file
+//        Allocate a sector for the file header, in the block group of
+//	    the directory's header if there is room
+// 	  Set up its index, all holes, for the initial size
 //	  Add the name to the directory
 //	  Store the new file header on disk 
 //	  Flush the changes to the bitmap and the directory back to disk
@@ -172,10 +558,11 @@ FileSystem::~FileSystem()
 //	Return TRUE if everything goes ok, otherwise, return FALSE.
 //
 // 	Create fails if:
+//   		a directory on the path does not exist
 //   		file is already in directory
 //	 	no free space for file header
-//	 	no free entry for file in directory
-//	 	no free space for data blocks for the file 
+//	 	file is too big for the index
+//	 	no free space to grow the directory
 //
 // 	Note that this implementation assumes there is no concurrent access
 //	to the file system!
@@ -188,67 +575,55 @@ bool
 FileSystem::Create(char *name, int initialSize)
 {
     Directory *directory;
-    PersistentBitmap *freeMap;
     FileHeader *hdr;
-    int sector;
+    OpenFile *dirFile;
+    int sector, dirSector;
     bool success;
 
     DEBUG(dbgFile, "Creating file " << name << " size " << initialSize);
 
-    DEBUG(dbgFile, "Creating file's absolute path is "<<name);
-
-    directory = new Directory(NumDirEntries);
-    directory->FetchFrom(directoryFile);
-
     //MP4 modified
-    OpenFile *tmpFile = directoryFile; //directoryFile => root directory
-    char *token = strtok(name, "/");
-    char *prev_token = token;
-    bool firstTmp = TRUE;
-
-    while(token != NULL){
-        DEBUG(dbgFile, "token not null so in while");
-        sector = directory -> Find(token);
-        if(sector == -1)break;
-        DEBUG(dbgFile, "current directory is " << token);
-        if(firstTmp)firstTmp = FALSE;
-        else delete tmpFile;
-        tmpFile = new OpenFile(sector);
-        directory -> FetchFrom(tmpFile);
-        prev_token = token;
-        token = strtok(NULL, "/");
-    }
-    DEBUG(dbgFile, "out of while");
-    if(token == NULL)name = prev_token;
-    else name = token;
+    dirSector = Resolve(name, &name);
+    if (dirSector == -1 || name == NULL)
+	return FALSE;			// no such directory
     DEBUG(dbgFile, "file name is " << name);
+
+    journal->Begin();
+    dirFile = OpenDirectory(dirSector);
+    directory = new Directory(dirFile);
+
     if (directory->Find(name) != -1)
       success = FALSE;			// file is already in directory
     else {	
-        freeMap = new PersistentBitmap(freeMapFile,NumSectors);
+        freeMap->SetGoal(dirSector);	// in the directory's block group
         sector = freeMap->FindAndSet();	// find a sector to hold the file header
     	if (sector == -1) 		
             success = FALSE;		// no free block for file header 
-        else if (!directory->Add(name, sector, TRUE))
-            success = FALSE;	// no space in directory
-	    else {
+        else {
     	    hdr = new FileHeader;
-            if (!hdr->Allocate(freeMap, initialSize))
-                    success = FALSE;	// no space on disk for data
-            else {	
+            if (!hdr->Allocate(freeMap, initialSize)) {
+                    freeMap->Clear(sector);
+                    success = FALSE;	// file too big
+            } else if (!directory->Add(name, sector, TRUE)) {
+                    hdr->Deallocate(freeMap);
+                    freeMap->Clear(sector);
+                    freeMap->WriteBack(freeMapFile);
+                    success = FALSE;	// no space to grow the directory
+            } else {	
                 success = TRUE;
                 // everthing worked, flush all changes back to disk
+                // (the directory has written itself already)
                 hdr->WriteBack(sector); 		
-                directory->WriteBack(tmpFile);
                 freeMap->WriteBack(freeMapFile);
+                dentries->Enter(dirSector, name, sector, TRUE);
             }
             delete hdr;
         }
-        delete freeMap;
     }
     delete directory;
+    CloseDirectory(dirFile);
+    journal->End();
     DEBUG(dbgFile, "create file end.");
-    if(!firstTmp)delete tmpFile;
     return success;
 }
 
@@ -256,56 +631,37 @@ FileSystem::Create(char *name, int initialSize)
 // FileSystem::Open
 // 	Open a file for reading and writing.  
 //	To open a file:
-//	  Find the location of the file's header, using the directory 
+//	  Find the location of the file's header, by resolving the path
 //	  Bring the header into memory
 //
+//	Return NULL if the file does not exist.
+//
 //	"name" -- the text name of the file to be opened
 //----------------------------------------------------------------------
 
 //MP4 modified
 OpenFile *FileSystem::Open(char *name)
 {
-    Directory *directory = new Directory(NumDirEntries);
-    OpenFile *openFile = NULL;
     int sector;
+    bool isFile;
+
     DEBUG(dbgFile, "Opening file" << name);
-    directory -> FetchFrom(directoryFile);
-    OpenFile *tmpFile = directoryFile;
-    char *token = strtok(name, "/");
-    char *prev_token = token;
-    bool firstTmp = true;
-
-    while(token != NULL){
-        sector = directory -> Find(token);
-        if(sector == -1||directory->IsFile(token))break;
-        DEBUG(dbgFile, "Open file in directory " << token);
-        if(firstTmp)firstTmp = false;
-        else delete tmpFile;
-        tmpFile = new OpenFile(sector);
-        directory -> FetchFrom(tmpFile);
-        prev_token = token;
-        token = strtok(NULL, "/");
-    }
-    if(token == NULL)name = prev_token;
-    else name = token;
-    DEBUG(dbgFile, "Open file name is " << name);
-    directory->FetchFrom(tmpFile);
-    sector = directory->Find(name);
-    if(sector >= 0){
-        currentOpenedFile = new OpenFile(sector);
-    }
-    delete directory;
-    if(!firstTmp)delete tmpFile;
-    return currentOpenedFile;
+    sector = ResolveAll(name, &isFile);
+    if (sector == -1)
+	return NULL;			// file not found
+    return new OpenFile(sector);
 }
 
 //----------------------------------------------------------------------
 // FileSystem::Remove
 // 	Delete a file from the file system.  This requires:
 //	    Remove it from the directory
-//	    Delete the space for its header
-//	    Delete the space for its data blocks
-//	    Write changes to directory, bitmap back to disk
+//	    Write changes to the directory back to disk
+//	    Queue its header for the reclaimer thread, which deletes
+//	    the space for its header and data blocks in the background
+//
+//	As in UNIX, if the file is open, only the name goes away now;
+//	the space is queued when the file is closed for the last time.
 //
 //	Return TRUE if the file was deleted, FALSE if the file wasn't
 //	in the file system.
@@ -317,56 +673,37 @@ bool
 FileSystem::Remove(char *name)
 { 
     Directory *directory;
-    PersistentBitmap *freeMap;
-    FileHeader *fileHdr;
-    int sector;
+    OpenFile *dirFile;
+    int sector, dirSector;
+    bool isFile;
     
-    directory = new Directory(NumDirEntries);
-    directory->FetchFrom(directoryFile);
-
     //MP4 modified
-    OpenFile *tmpFile = directoryFile;
-    char *token = strtok(name, "/");
-    char *prev_token = token;
-    bool firstTmp = true;
-
-    while(token != NULL){
-        sector = directory -> Find(token);
-        if(sector == -1||directory->IsFile(token))break;
-        DEBUG(dbgFile, "open file in directory " << token);
-        if(firstTmp)firstTmp = false;
-        else delete tmpFile;
-        tmpFile = new OpenFile(sector);
-        directory -> FetchFrom(tmpFile);
-        prev_token = token;
-        token = strtok(NULL, "/");
-    }
-    if(token == NULL)name = prev_token;
-    else name = token;
+    dirSector = Resolve(name, &name);
+    if (dirSector == -1 || name == NULL)
+	return FALSE;			// no such directory
 
-    directory -> FetchFrom(tmpFile);
+    journal->Begin();
+    dirFile = OpenDirectory(dirSector);
+    directory = new Directory(dirFile);
 
     sector = directory->Find(name);
     if (sector == -1) {
        delete directory;
-       if(!firstTmp)delete tmpFile;
+       CloseDirectory(dirFile);
+       journal->End();
        return FALSE;			 // file not found 
     }
-    fileHdr = new FileHeader;
-    fileHdr->FetchFrom(sector);
-
-    freeMap = new PersistentBitmap(freeMapFile,NumSectors);
-
-    fileHdr->Deallocate(freeMap);  		// remove data blocks
-    freeMap->Clear(sector);			// remove header block
-    directory->Remove(name);
-
-    freeMap->WriteBack(freeMapFile);		// flush to disk
-    directory->WriteBack(tmpFile);        // flush to disk
-    delete fileHdr;
+    isFile = directory->IsFile(name);
+    directory->Remove(name);		// flushed to disk as it goes
+    dentries->Enter(dirSector, name, -1, FALSE);
+    if (!isFile)
+	dentries->Purge(sector);		// its sector may be reused
+
+    if (!kernel->openFileTable->MarkRemoved(sector))
+	Reclaim(sector);			// remove header and data blocks
     delete directory;
-    delete freeMap;
-    if(!firstTmp)delete tmpFile;
+    CloseDirectory(dirFile);
+    journal->End();
     return TRUE;
 } 
 
@@ -378,30 +715,21 @@ FileSystem::Remove(char *name)
 void
 FileSystem::List(char *name)
 {
-    Directory *directory = new Directory(NumDirEntries);
+    Directory *directory;
+    OpenFile *dirFile;
+    int sector;
+    bool isFile;
 
-    directory->FetchFrom(directoryFile);
     //MP4 modified
-    int sector;
-    OpenFile *tmpFile = directoryFile;
-    char *token = strtok(name, "/");
-    bool firstTmp = true;
-    while(token != NULL){
-        if((sector = directory -> Find(token)) == -1)break;
-        if(firstTmp)firstTmp = false;
-        else delete tmpFile;
-        tmpFile = new OpenFile(sector);
-        directory -> FetchFrom(tmpFile);
-        token = strtok(NULL, "/");
-    }
+    sector = ResolveAll(name, &isFile);
+    if (sector == -1 || isFile)
+	return;				// no such directory
 
+    dirFile = OpenDirectory(sector);
+    directory = new Directory(dirFile);
     directory->List();
     delete directory;
-    //cout<<"end delete directory"<<endl;
-    delete token;
-    //cout<<"end delete token"<<endl;
-    if(!firstTmp)delete tmpFile;
-    //cout<<"end if"<<endl;
+    CloseDirectory(dirFile);
 }
 
 //----------------------------------------------------------------------
@@ -419,8 +747,7 @@ FileSystem::Print()
 {
     FileHeader *bitHdr = new FileHeader;
     FileHeader *dirHdr = new FileHeader;
-    PersistentBitmap *freeMap = new PersistentBitmap(freeMapFile,NumSectors);
-    Directory *directory = new Directory(NumDirEntries);
+    Directory *directory = new Directory(directoryFile);
 
     printf("Bit map file header:\n");
     bitHdr->FetchFrom(FreeMapSector);
@@ -432,12 +759,10 @@ FileSystem::Print()
 
     freeMap->Print();
 
-    directory->FetchFrom(directoryFile);
     directory->Print();
 
     delete bitHdr;
     delete dirHdr;
-    delete freeMap;
     delete directory;
 } 
 
@@ -448,97 +773,79 @@ bool FileSystem::CreateDirectory(char *name)
 {
     Directory *directory;
     Directory *subDirectory;
-    PersistentBitmap *freeMap;
     FileHeader *hdr;
-    int sector;
-    bool success;
+    OpenFile *dirFile;
     OpenFile *subDirectoryFile;
+    int sector, dirSector;
+    bool success;
     
     DEBUG(dbgFile, "Creating directory's absolute path is " << name);
 
-    directory = new Directory(NumDirEntries);
-    directory -> FetchFrom(directoryFile);
-    OpenFile *tmpFile = directoryFile;
-    char *token = strtok(name, "/");
-    char *prev_token = token;
-    bool firstTmp = true;
-
-    while(token != NULL){
-        sector = directory -> Find(token);
-        if(sector == -1)break;
-        DEBUG(dbgFile, "current directory is " << token);
-        if(firstTmp)firstTmp = false;
-        else delete tmpFile;
-        tmpFile = new OpenFile(sector);
-        directory -> FetchFrom(tmpFile);
-        prev_token = token;
-        token = strtok(NULL, "/");
-    }
-    if(token == NULL)name = prev_token;
-    else name = token;
+    dirSector = Resolve(name, &name);
+    if (dirSector == -1 || name == NULL)
+	return FALSE;			// no such directory
     DEBUG(dbgFile, "directory name is " << name);
-    subDirectory = new Directory(NumDirEntries);
+
+    journal->Begin();
+    dirFile = OpenDirectory(dirSector);
+    directory = new Directory(dirFile);
+
     if(directory->Find(name) != -1)success = FALSE;
     else
     {
-        freeMap = new PersistentBitmap(freeMapFile, NumSectors);
+        freeMap -> SetGoal(dirSector);
         sector = freeMap -> FindAndSet();
         if(sector == -1)success = FALSE;
-        else if(!directory->Add(name, sector, FALSE))
-            success = FALSE;
         else{
             hdr = new FileHeader;
-            if(!hdr -> Allocate(freeMap, DirectoryFileSize))success = FALSE;
+            freeMap -> SetGoal(sector);
+            if(!hdr -> Allocate(freeMap, DirectoryFileSize)
+			|| !hdr->Fill(freeMap, 0, 
+				divRoundUp(DirectoryFileSize, SectorSize))){
+                hdr -> Deallocate(freeMap);
+                freeMap -> Clear(sector);
+                success = FALSE;
+            }
+            else if(!directory->Add(name, sector, FALSE)){
+                hdr -> Deallocate(freeMap);
+                freeMap -> Clear(sector);
+                freeMap -> WriteBack(freeMapFile);
+                success = FALSE;	// no space to grow the directory
+            }
             else{
                 success = TRUE;
                 hdr -> WriteBack(sector);
                 subDirectoryFile = new OpenFile(sector);
-                subDirectory -> WriteBack(subDirectoryFile);
-                directory -> WriteBack(tmpFile);
+                subDirectory = new Directory(subDirectoryFile);
+                subDirectory -> Format();
                 freeMap -> WriteBack(freeMapFile);
+                dentries->Purge(sector);
+                dentries->Enter(dirSector, name, sector, FALSE);
+                delete subDirectory;
+                delete subDirectoryFile;
             }
             delete hdr;
         }
-        delete freeMap;
     }
-    delete subDirectoryFile;
-    delete subDirectory;
     delete directory;
-    if(!firstTmp)delete tmpFile;
+    CloseDirectory(dirFile);
+    journal->End();
     return success;
 }
-int FileSystem::Read(char *buffer, int size, OpenFileId id)
-{
-    return currentOpenedFile -> Read(buffer, size);
-}
-int FileSystem::Write(char *buffer, int size, OpenFileId id)
-{
-    return currentOpenedFile -> Write(buffer, size);
-}
-int FileSystem::Close(OpenFileId id)
-{
-    delete currentOpenedFile;
-    currentOpenedFile = NULL;
-    return 1;
-}
 void FileSystem::RecursivelyList(char *name)
 {
-    Directory *directory = new Directory(NumDirEntries);
-    directory->FetchFrom(directoryFile);
+    Directory *directory;
+    OpenFile *dirFile;
     int sector;
-    OpenFile *tmpFile = directoryFile;
-    char *token = strtok(name, "/");
-    bool firstTmp = true;
-    while(token != NULL){
-        sector = directory -> Find(token);
-        if(sector == -1)break;
-        if(firstTmp)firstTmp = false;
-        else delete tmpFile;
-        tmpFile = new OpenFile(sector);
-        directory -> FetchFrom(tmpFile);
-        token = strtok(NULL, "/");
-    }
+    bool isFile;
+
+    sector = ResolveAll(name, &isFile);
+    if (sector == -1 || isFile)
+	return;				// no such directory
+
+    dirFile = OpenDirectory(sector);
+    directory = new Directory(dirFile);
     directory -> RecursivelyList();
     delete directory;
-    if(!firstTmp)delete tmpFile;
-}
\ No newline at end of file
+    CloseDirectory(dirFile);
+}
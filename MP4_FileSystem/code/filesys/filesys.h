@@ -68,14 +68,40 @@ class FileSystem {
 };
 
 #else // FILESYS
+class DentryCache;
+class FileHeader;
+class Journal;
+class PersistentBitmap;
+class Semaphore;
+
+// By default, a file that grows is given space 8 sectors (1KB) at a
+// time, so that appending in small writes does not go back to the
+// free map every time.
+
+const int DefaultPreallocSectors = 8;
+
+// The following class defines a block of a removed file waiting for
+// the reclaimer: a header or index block, and a journal ticket (see
+// Journal::Ticket) for the removal, which must be committed before
+// any of the file's space can be used again.
+
+class RemovedBlock {
+  public:
+    int sector;				// header or index block to free
+    int ticket;				// what must be committed first
+};
+
 class FileSystem {
   public:
-    FileSystem(bool format);		// Initialize the file system.
+    FileSystem(bool format, int preallocSectors = DefaultPreallocSectors);
+					// Initialize the file system.
 					// Must be called *after* "synchDisk" 
 					// has been initialized.
     					// If "format", there is nothing on
 					// the disk, so initialize the directory
     					// and the bitmap of free blocks.
+					// Files that grow are given space
+					// "preallocSectors" at a time.
 	// MP4 mod tag
 	~FileSystem();
 
@@ -91,10 +117,17 @@ class FileSystem {
     void Print();			// List all the files and their contents
 
 	//MP4 modified
-	OpenFile* currentOpenedFile;
-	int Read(char *buffer, int size, OpenFileId id);
-	int Write(char *buffer, int size, OpenFileId id);
-	int Close(OpenFileId id);
+	bool ExtendFile(OpenFile *file, int fileSize);
+					// Grow a file written past its end
+	int FillFile(OpenFile *file, int first, int count);
+					// Allocate holes about to be written;
+					// return how many sectors got space
+	int RoomLeft();			// # of sectors the current
+					// transaction may still log
+	void Reclaim(int sector);	// Free a removed file in the
+					// background, once it is closed
+					// for the last time
+	void Reclaimer();		// Body of the thread that frees them
 
 	bool CreateDirectory(char *name);
 	bool RecursivelyRemove(char *name);
@@ -106,6 +139,32 @@ class FileSystem {
 					// represented as a file
    OpenFile* directoryFile;		// "Root" directory -- list of 
 					// file names, represented as a file
+   PersistentBitmap *freeMap;		// In-core copy of the bitmap,
+					// read in when mounted
+   Journal *journal;			// Log making each operation atomic
+   DentryCache *dentries;		// Recent name lookups in directories
+   int preallocSectors;			// Unit of allocation for growing files
+   ::List<RemovedBlock *> *reclaimQueue;
+					// Index blocks of removed files, still
+					// to be freed
+   Semaphore *reclaimPending;		// Counts the entries in reclaimQueue,
+					// plus one once the reclaimer is to
+					// stop
+   bool reclaimStopping;		// Is the file system going away?
+   Semaphore *reclaimStopped;		// The reclaimer has finished
+
+   int Resolve(char *path, char **leaf);
+					// Find the directory holding the
+					// last component of "path"
+   int ResolveAll(char *path, bool *isFile);
+					// Find the header of "path" itself
+   int LookupIn(int dirSector, char *name, bool *isFile);
+					// Find "name" in one directory
+   OpenFile *OpenDirectory(int sector);	// Open a directory by header sector
+   void CloseDirectory(OpenFile *file);	// and close it again
+   void ReclaimStep();			// Free one block of the index of
+					// the next file waiting for it;
+					// only the reclaimer may call it
 };
 
 #endif // FILESYS
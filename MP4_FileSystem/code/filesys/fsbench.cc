@@ -0,0 +1,332 @@
+// fsbench.cc
+//	A benchmark of the file system, run by "nachos -f -bench" (or
+//	"make bench" in the build directory).
+//
+//	It drives FileSystem and OpenFile directly through a series of
+//	workloads: sequential and random reads and writes, a storm of
+//	creates and deletes, opens of a deep path, files on either side
+//	of each size at which the index gets another level, and a log
+//	appended to a few bytes at a time.  For
+//	each workload it prints one line of comma-separated values: how
+//	many operations were done, and the simulated ticks, disk requests
+//	and host time they took, in all and per operation, and how many
+//	tracks the disk head moved across in seeks.  The first line names
+//	the columns.
+//
+//	Each workload ends by writing back the disk cache, so that the
+//	writes it caused are charged to it and not to the next one.  Keep
+//	the workloads and the format stable, so that the output of two
+//	versions of Nachos can be compared line by line.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+#ifndef FILESYS_STUB
+
+#include "copyright.h"
+#include "main.h"
+#include "filehdr.h"
+#include "filesys.h"
+#include "openfile.h"
+#include "synchdisk.h"
+#include "fsbench.h"
+
+// The parameters of the workloads.
+static const int SequentialBytes = 512 * 1024;	// file for the I/O tests
+static const int SequentialChunk = 1024;	// bytes per sequential op
+static const int RandomChunk = 2 * SectorSize;	// bytes per random op
+static const int RandomOps = 1024;
+static const int StormFiles = 256;		// files created, then deleted
+static const int PathDepth = 8;			// directories above the file
+static const int DeepOpens = 512;
+static const int GrowChunk = 4096;		// bytes per op growing a file
+static const int LogBytes = 16 * 1024;		// size of the appended log
+static const int LogRecord = 8;			// bytes per append
+
+// The sizes at which a file changes shape: the largest inline file,
+// and the largest file each depth of index can map, each followed by
+// one byte more (see SpanOf in filehdr.cc).
+static const int IndexSizes[] = {
+    MaxInlineBytes, MaxInlineBytes + 1,
+    NumDirect * SectorSize, NumDirect * SectorSize + 1,
+    NumDirect * NumDirect * SectorSize, NumDirect * NumDirect * SectorSize + 1,
+    NumDirect * NumDirect * NumDirect * SectorSize,
+	NumDirect * NumDirect * NumDirect * SectorSize + 1,
+};
+
+static char buffer[GrowChunk];			// data for every op
+
+//----------------------------------------------------------------------
+// BenchRun
+// 	Measures one workload: the counters are read when it is
+//	constructed, and again when Done is called, which prints the
+//	difference.
+//----------------------------------------------------------------------
+
+class BenchRun {
+  public:
+    BenchRun(const char *name);		// Start measuring "name"
+    void Done(int ops);			// Stop, and print a line for "ops"
+					// operations
+
+  private:
+    const char *name;
+    int ticks, reads, writes, seeks;	// simulated counters at the start
+    int tracks;
+    long usec;				// host time at the start
+};
+
+BenchRun::BenchRun(const char *workload)
+{
+    name = workload;
+    ticks = kernel->stats->totalTicks;
+    reads = kernel->stats->numDiskReads;
+    writes = kernel->stats->numDiskWrites;
+    seeks = kernel->stats->numDiskSeeks;
+    tracks = kernel->stats->numSeekTracks;
+    usec = HostTime();
+}
+
+void
+BenchRun::Done(int ops)
+{
+    kernel->synchDisk->Sync();		// charge the write-back to us
+
+    ticks = kernel->stats->totalTicks - ticks;
+    reads = kernel->stats->numDiskReads - reads;
+    writes = kernel->stats->numDiskWrites - writes;
+    seeks = kernel->stats->numDiskSeeks - seeks;
+    tracks = kernel->stats->numSeekTracks - tracks;
+    usec = HostTime() - usec;
+    ops = max(ops, 1);
+    printf("%s,%d,%d,%d,%d,%d,%ld,%.1f,%.1f,%d,%.1f\n", name, ops, ticks,
+		reads, writes, seeks, usec, (double) ticks / ops,
+		(double) usec / ops, tracks, (double) tracks / ops);
+}
+
+//----------------------------------------------------------------------
+// Path
+// 	Return a fresh copy of "name", good until the next call.  The
+//	file system takes paths apart in place, so the same path cannot
+//	be handed to it twice.
+//----------------------------------------------------------------------
+
+static char *
+Path(char *name)
+{
+    static char path[64];
+
+    ASSERT(strlen(name) < sizeof(path));
+    strcpy(path, name);
+    return path;
+}
+
+//----------------------------------------------------------------------
+// OpenOrDie
+// 	Open a file the benchmark has just created; it had better be
+//	there.
+//----------------------------------------------------------------------
+
+static OpenFile *
+OpenOrDie(char *name)
+{
+    OpenFile *file = kernel->fileSystem->Open(Path(name));
+
+    ASSERT(file != NULL);
+    return file;
+}
+
+//----------------------------------------------------------------------
+// SequentialAndRandom
+// 	Write a file from start to end, read it back the same way, then
+//	write and read it at random places.
+//----------------------------------------------------------------------
+
+static void
+SequentialAndRandom()
+{
+    char name[] = "/bench/seq";
+    OpenFile *file;
+    int i, ops;
+
+    ASSERT(kernel->fileSystem->Create(Path(name), 0));
+
+    BenchRun seqWrite("seq_write");
+    file = OpenOrDie(name);
+    for (ops = 0; ops * SequentialChunk < SequentialBytes; ops++)
+	file->Write(buffer, SequentialChunk);
+    delete file;
+    seqWrite.Done(ops);
+
+    BenchRun seqRead("seq_read");
+    file = OpenOrDie(name);
+    for (ops = 0; file->Read(buffer, SequentialChunk) > 0; ops++)
+	;
+    delete file;
+    seqRead.Done(ops);
+
+    BenchRun randWrite("rand_write");
+    file = OpenOrDie(name);
+    for (i = 0; i < RandomOps; i++)
+	file->WriteAt(buffer, RandomChunk,
+		(RandomNumber() % (SequentialBytes / RandomChunk)) * RandomChunk);
+    delete file;
+    randWrite.Done(RandomOps);
+
+    BenchRun randRead("rand_read");
+    file = OpenOrDie(name);
+    for (i = 0; i < RandomOps; i++)
+	file->ReadAt(buffer, RandomChunk,
+		(RandomNumber() % (SequentialBytes / RandomChunk)) * RandomChunk);
+    delete file;
+    randRead.Done(RandomOps);
+
+    ASSERT(kernel->fileSystem->Remove(Path(name)));
+}
+
+//----------------------------------------------------------------------
+// CreateDeleteStorm
+// 	Create many small files in one directory, then delete them all.
+//----------------------------------------------------------------------
+
+static void
+CreateDeleteStorm()
+{
+    char dir[] = "/bench/storm";
+    char name[32];
+    int i;
+
+    ASSERT(kernel->fileSystem->CreateDirectory(Path(dir)));
+
+    BenchRun createRun("create");
+    for (i = 0; i < StormFiles; i++) {
+	sprintf(name, "%s/f%d", dir, i);
+	ASSERT(kernel->fileSystem->Create(Path(name), 0));
+    }
+    createRun.Done(StormFiles);
+
+    BenchRun removeRun("remove");
+    for (i = 0; i < StormFiles; i++) {
+	sprintf(name, "%s/f%d", dir, i);
+	ASSERT(kernel->fileSystem->Remove(Path(name)));
+    }
+    removeRun.Done(StormFiles);
+}
+
+//----------------------------------------------------------------------
+// DeepOpen
+// 	Open and close, over and over, a file PathDepth directories down.
+//----------------------------------------------------------------------
+
+static void
+DeepOpen()
+{
+    char path[16 + 3 * PathDepth];
+    int i;
+
+    strcpy(path, "/bench");
+    for (i = 0; i < PathDepth; i++) {
+	sprintf(path + strlen(path), "/d%d", i);
+	ASSERT(kernel->fileSystem->CreateDirectory(Path(path)));
+    }
+    strcat(path, "/f");
+    ASSERT(kernel->fileSystem->Create(Path(path), 0));
+
+    BenchRun openRun("deep_open");
+    for (i = 0; i < DeepOpens; i++)
+	delete OpenOrDie(path);
+    openRun.Done(DeepOpens);
+}
+
+//----------------------------------------------------------------------
+// IndexLevels
+// 	Grow a file to each of IndexSizes by appending to it, then read
+//	it back, and remove it.
+//----------------------------------------------------------------------
+
+static void
+IndexLevels()
+{
+    char name[] = "/bench/grow";
+    char workload[32];
+    OpenFile *file;
+    int i, size, ops;
+
+    for (i = 0; i < (int) (sizeof(IndexSizes) / sizeof(int)); i++) {
+	size = IndexSizes[i];
+	ASSERT(kernel->fileSystem->Create(Path(name), 0));
+
+	sprintf(workload, "grow_%d", size);
+	BenchRun growRun(workload);
+	file = OpenOrDie(name);
+	for (ops = 0; ops * GrowChunk < size; ops++)
+	    file->Write(buffer, min(GrowChunk, size - ops * GrowChunk));
+	ASSERT(file->Length() == size);
+	delete file;
+	growRun.Done(ops);
+
+	sprintf(workload, "read_%d", size);
+	BenchRun readRun(workload);
+	file = OpenOrDie(name);
+	for (ops = 0; file->Read(buffer, GrowChunk) > 0; ops++)
+	    ;
+	delete file;
+	readRun.Done(ops);
+
+	ASSERT(kernel->fileSystem->Remove(Path(name)));
+    }
+}
+
+//----------------------------------------------------------------------
+// SmallAppends
+// 	Append to a log a few bytes at a time, as a program writing
+//	records through the Write system call would.
+//----------------------------------------------------------------------
+
+static void
+SmallAppends()
+{
+    char name[] = "/bench/log";
+    OpenFile *file;
+    int ops;
+
+    ASSERT(kernel->fileSystem->Create(Path(name), 0));
+
+    BenchRun appendRun("small_append");
+    file = OpenOrDie(name);
+    for (ops = 0; ops * LogRecord < LogBytes; ops++)
+	file->Write(buffer, LogRecord);
+    delete file;
+    appendRun.Done(ops);
+
+    ASSERT(kernel->fileSystem->Remove(Path(name)));
+}
+
+//----------------------------------------------------------------------
+// FileSystemBench
+// 	Run every workload, in a directory of its own.
+//----------------------------------------------------------------------
+
+void
+FileSystemBench()
+{
+    char dir[] = "/bench";
+
+    if (!kernel->fileSystem->CreateDirectory(Path(dir))) {
+	printf("Bench: couldn't create %s; format the disk first (-f)\n", dir);
+	return;
+    }
+    for (int i = 0; i < GrowChunk; i++)
+	buffer[i] = 'a' + i % 26;
+
+    printf("workload,ops,ticks,disk_reads,disk_writes,disk_seeks,"
+		"host_usec,ticks_per_op,host_usec_per_op,"
+		"seek_tracks,seek_tracks_per_op\n");
+    SequentialAndRandom();
+    CreateDeleteStorm();
+    DeepOpen();
+    IndexLevels();
+    SmallAppends();
+}
+
+#endif // FILESYS_STUB
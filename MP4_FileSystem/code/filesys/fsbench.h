@@ -0,0 +1,19 @@
+// fsbench.h
+//	Interface to the file system benchmark, run by "nachos -bench".
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef FSBENCH_H
+#define FSBENCH_H
+
+#include "copyright.h"
+
+// Run every workload of the benchmark against kernel->fileSystem,
+// printing one line of comma-separated results per workload.  The
+// disk should have just been formatted.
+
+extern void FileSystemBench();
+
+#endif // FSBENCH_H
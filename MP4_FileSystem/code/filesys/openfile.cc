@@ -5,7 +5,12 @@
 //	the OpenFile data structure).
 //
 //	Also as in UNIX, for convenience, we keep the file header in
-//	memory while the file is open.
+//	memory while the file is open; all the OpenFiles of one file
+//	share a single copy, through the system-wide OpenFileTable, which
+//	keeps recently closed headers around too.  Along with it we keep a block map
+//	of the data sectors already located through the header, so that
+//	walking a multi-level index only happens once per index leaf for
+//	as long as the file stays open.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -21,33 +26,179 @@
 //----------------------------------------------------------------------
 // OpenFile::OpenFile
 // 	Open a Nachos file for reading and writing.  Bring the file header
-//	into memory while the file is open.
+//	into memory while the file is open, unless it is there already
+//	(because some other OpenFile has it, or had it lately).
 //
 //	"sector" -- the location on disk of the file header for this file
 //----------------------------------------------------------------------
 
 OpenFile::OpenFile(int sector)
 { 
-    hdr = new FileHeader;
-    hdr->FetchFrom(sector);
+    hdr = kernel->openFileTable->Acquire(sector);
     seekPosition = 0;
     hdr_num = sector;
+    streamEnd = 0;
+    readAhead = 0;
+    readAheadEnd = 0;
+    pending = new char[SectorSize];
+    pendingStart = pendingEnd = 0;
+
+    numLeaves = 0;
+    blockMap = NULL;
+    ResetBlockMap();
 }
 
 //----------------------------------------------------------------------
 // OpenFile::~OpenFile
-// 	Close a Nachos file, de-allocating any in-memory data structures.
+// 	Close a Nachos file, writing out what is left of small Writes,
+//	and de-allocating any in-memory data structures.
 //----------------------------------------------------------------------
 
 OpenFile::~OpenFile()
 {
-    delete hdr;
+    Flush();
+    delete [] pending;
+    for (int i = 0; i < numLeaves; i++)
+	delete [] blockMap[i];
+    delete [] blockMap;
+    kernel->openFileTable->Release(hdr_num);
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ResetBlockMap
+// 	Throw away the block map, and make a new, empty one with room for
+//	every index leaf of the file as it is now mapped.
+//----------------------------------------------------------------------
+
+void
+OpenFile::ResetBlockMap()
+{
+    for (int i = 0; i < numLeaves; i++)
+	delete [] blockMap[i];
+    delete [] blockMap;
+
+    mappedVersion = hdr->MapVersion();
+    numLeaves = divRoundUp(hdr->AllocatedSectors(), NumDirect);
+    blockMap = new int *[numLeaves];
+    for (int i = 0; i < numLeaves; i++)
+	blockMap[i] = NULL;		// filled in on first access
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Extend
+// 	Make the file at least "fileSize" bytes long, mapping sectors in
+//	units of "chunk", and write the new header back to disk.
+//	Return FALSE if there is not enough space.  The caller writes
+//	back the free map.
+//
+//	"freeMap" -- the bit map of free disk sectors
+//	"fileSize" -- the new length of the file, in bytes
+//	"chunk" -- the unit of allocation, in sectors
+//----------------------------------------------------------------------
+
+bool
+OpenFile::Extend(PersistentBitmap *freeMap, int fileSize, int chunk)
+{
+    if (fileSize <= hdr->FileLength())
+	return TRUE;
+    if (!hdr->Extend(freeMap, fileSize, chunk))
+	return FALSE;
+    hdr->WriteBack(hdr_num);
+    return TRUE;			// SectorOf notices the new index
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Fill
+// 	Allocate disk space for the holes among "count" sectors of the
+//	file from sector "first", and write the header back to disk.
+//	Return FALSE if there is not enough space.  The caller writes
+//	back the free map.
+//
+//	"freeMap" -- the bit map of free disk sectors
+//	"first" -- the first sector of the file to allocate
+//	"count" -- the number of sectors
+//----------------------------------------------------------------------
+
+bool
+OpenFile::Fill(PersistentBitmap *freeMap, int first, int count)
+{
+    if (!hdr->Fill(freeMap, first, count))
+	return FALSE;
+    hdr->WriteBack(hdr_num);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::PlaceNear
+// 	Return the disk sector that space for sector "fileSector" of the
+//	file should be allocated near: the closest allocated sector before
+//	it, looking back as far as one index leaf, so that the file goes
+//	on where it left off; or else the file's header.
+//----------------------------------------------------------------------
+
+int
+OpenFile::PlaceNear(int fileSector)
+{
+    int i, sector;
+
+    if (!hdr->IsInline())
+	for (i = min(fileSector, hdr->AllocatedSectors()) - 1; 
+		i >= 0 && i >= fileSector - (int) NumDirect; i--) {
+	    sector = SectorOf(i * SectorSize);
+	    if (sector != -1)
+		return sector;
+	}
+    return hdr_num;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::SectorOf
+// 	Return the disk sector holding the byte at "offset", like
+//	FileHeader::ByteToSector.  The first access to any part of the
+//	file resolves the whole index leaf covering it and remembers the
+//	result, so later accesses to the same NumDirect sectors cost no
+//	header reads at all.  If the index has changed (perhaps through
+//	another OpenFile) since the map was made, the map starts over.
+//	Return -1 for a hole.
+//
+//	Resolving a leaf may wait for the disk, so it is filled in on the
+//	side and only entered in the map once it is complete, and only
+//	if the index has not changed in the meantime; otherwise we look
+//	again.
+//
+//	"offset" -- a byte offset within the file
+//----------------------------------------------------------------------
+
+int
+OpenFile::SectorOf(int offset)
+{
+    int sector = offset / SectorSize;
+    int leaf = sector / NumDirect;
+    int *sectors;
+    int version;
+
+    for (;;) {
+	if (mappedVersion != hdr->MapVersion())
+	    ResetBlockMap();
+	ASSERT(leaf >= 0 && leaf < numLeaves);
+	if (blockMap[leaf] != NULL)
+	    return blockMap[leaf][sector % NumDirect];
+	version = mappedVersion;
+	sectors = new int[NumDirect];
+	hdr->LeafSectors(offset, sectors);
+	if (version == mappedVersion && version == hdr->MapVersion()
+			&& blockMap[leaf] == NULL)
+	    blockMap[leaf] = sectors;
+	else
+	    delete [] sectors;		// changed meanwhile
+    }
 }
 
 //----------------------------------------------------------------------
 // OpenFile::Seek
 // 	Change the current location within the open file -- the point at
-//	which the next Read or Write will start from.
+//	which the next Read or Write will start from.  Small Writes
+//	gathered so far are written out first.
 //
 //	"position" -- the location within the file for the next Read/Write
 //----------------------------------------------------------------------
@@ -55,6 +206,7 @@ OpenFile::~OpenFile()
 void
 OpenFile::Seek(int position)
 {
+    Flush();
     seekPosition = position;
 }	
 
@@ -66,6 +218,14 @@ OpenFile::Seek(int position)
 //
 //	Implemented using the more primitive ReadAt/WriteAt.
 //
+//	A Read that starts where the previous one ended continues a
+//	sequential stream, and the sectors after it are read ahead.
+//
+//	A Write of less than a sector is only gathered in memory (see
+//	Gather), and reported as done in full; so a program writing a
+//	few bytes at a time costs one disk write per sector, not a read
+//	and a write of every sector per Write.
+//
 //	"into" -- the buffer to contain the data to be read from disk 
 //	"from" -- the buffer containing the data to be written to disk 
 //	"numBytes" -- the number of bytes to transfer
@@ -74,16 +234,63 @@ OpenFile::Seek(int position)
 int
 OpenFile::Read(char *into, int numBytes)
 {
+   bool sequential = (seekPosition == streamEnd);
    int result = ReadAt(into, numBytes, seekPosition);
    seekPosition += result;
 
+   streamEnd = seekPosition;
+   if (sequential) {
+	readAhead = min(max(2 * readAhead, MinReadAhead), MaxReadAhead);
+	ReadAhead(seekPosition);
+   } else {
+	readAhead /= 2;			// the stream is broken
+	readAheadEnd = 0;
+   }
    return result;
 }
 
+//----------------------------------------------------------------------
+// OpenFile::ReadAhead
+// 	Start bringing the next "readAhead" sectors of the file after
+//	"position" into the disk cache, without waiting for them.  To
+//	keep ahead of the reader without asking on every Read, more is
+//	only requested once the reader is within half a window of the
+//	end of what was read ahead before.
+//
+//	"position" -- where the next sequential Read will start
+//----------------------------------------------------------------------
+
+void
+OpenFile::ReadAhead(int position)
+{
+    int first = position / SectorSize;
+    int last = min(first + readAhead, divRoundUp(Length(), SectorSize));
+    int i, run;
+
+    if (hdr->IsInline() || readAheadEnd - first > readAhead / 2)
+	return;				// nothing to read, or far enough ahead
+    for (i = max(first, readAheadEnd); i < last; i += run) {
+	run = RunLength(i, last - 1);
+	if (SectorOf(i * SectorSize) != -1)	// nothing to read in a hole
+	    kernel->synchDisk->ReadAhead(SectorOf(i * SectorSize), run);
+    }
+    readAheadEnd = max(readAheadEnd, last);
+}
+
 int
 OpenFile::Write(char *into, int numBytes)
 {
-   int result = WriteAt(into, numBytes, seekPosition);
+   int result, first;
+
+   if (numBytes > 0 && numBytes < SectorSize) {
+	// the part up to the end of this sector, and the rest, if any
+	first = min(numBytes, SectorSize - seekPosition % SectorSize);
+	Gather(into, first, seekPosition);
+	if (first < numBytes)
+	    Gather(into + first, numBytes - first, seekPosition + first);
+	result = numBytes;
+   } else
+	result = WriteAt(into, numBytes, seekPosition);
    seekPosition += result;
     if(debug->IsEnabled('x')){
         hdr->self_Print();
@@ -91,6 +298,55 @@ OpenFile::Write(char *into, int numBytes)
    return result;
 }
 
+//----------------------------------------------------------------------
+// OpenFile::Gather
+// 	Add a small Write, within one sector, to the bytes waiting in
+//	"pending".  They must follow on from what is there already, or
+//	that is written out first.  Once they reach the end of their
+//	sector, they are written out, with no need to read the sector
+//	first if they cover all of it.
+//
+//	Gathered bytes are seen by ReadAt and Length through this
+//	OpenFile, which write them out first; other OpenFiles of the file
+//	see them only once they are written out -- at the end of the
+//	sector, on Seek, or on close.  A file that cannot grow by them
+//	then (because the disk is full) loses them.
+//
+//	"from" -- the bytes to write
+//	"numBytes" -- how many of them
+//	"position" -- where in the file they go
+//----------------------------------------------------------------------
+
+void
+OpenFile::Gather(char *from, int numBytes, int position)
+{
+    ASSERT(position / SectorSize == (position + numBytes - 1) / SectorSize);
+    if (pendingEnd > pendingStart && position != pendingEnd)
+	Flush();			// not a continuation
+    if (pendingEnd == pendingStart)
+	pendingStart = pendingEnd = position;
+    bcopy(from, &pending[position % SectorSize], numBytes);
+    pendingEnd += numBytes;
+    if (pendingEnd % SectorSize == 0)
+	Flush();			// the sector is complete
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Flush
+// 	Write out the bytes gathered from small Writes, if there are any.
+//----------------------------------------------------------------------
+
+void
+OpenFile::Flush()
+{
+    int start = pendingStart, end = pendingEnd;
+
+    if (start == end)
+	return;
+    pendingStart = pendingEnd = 0;	// WriteAt must not flush them again
+    (void) WriteAt(&pending[start % SectorSize], end - start, start);
+}
+
 //----------------------------------------------------------------------
 // OpenFile::ReadAt/WriteAt
 // 	Read/write a portion of a file, starting at "position".
@@ -101,14 +357,32 @@ OpenFile::Write(char *into, int numBytes)
 //	boundary; however the disk only knows how to read/write a whole disk
 //	sector at a time.  Thus:
 //
+//	Both write out the bytes gathered from small Writes first, so
+//	that they are read, or overwritten, in the right order.
+//
+//	Only a partial first or last sector is staged in a buffer on the
+//	stack of the calling thread; the whole sectors in between go
+//	straight between the disk and the caller's buffer, with no copy.
+//
 //	For ReadAt:
-//	   We read in all of the full or partial sectors that are part of the
-//	   request, but we only copy the part we are interested in.
+//	   We read in the partial sectors that are part of the request,
+//	   but we only copy the part we are interested in.  Holes in the
+//	   file read as zeroes, without going to the disk.
 //	For WriteAt:
+//	   If the write runs past the end of the file, we first make the
+//	   file longer (any gap between the old end and "position" reads
+//	   back as zeroes).  If there is no room on disk, the write is
+//	   cut short at the end of the file.
 //	   We must first read in any sectors that will be partially written,
-//	   so that we don't overwrite the unmodified portion.  We then copy
-//	   in the data that will be modified, and write back all the full
-//	   or partial sectors that are part of the request.
+//	   so that we don't overwrite the unmodified portion.  Any holes
+//	   among the sectors are then given disk space; if there is not
+//	   enough, the write is cut short after the last sector that got
+//	   space (nothing is written if none did).  We then copy in the
+//	   data that will be modified, and write back all the full or
+//	   partial sectors that are part of the request.
+//
+//	A file small enough to live inside its header is read and written
+//	there, with no data sectors involved.
 //
 //	"into" -- the buffer to contain the data to be read from disk 
 //	"from" -- the buffer containing the data to be written to disk 
@@ -120,87 +394,494 @@ OpenFile::Write(char *into, int numBytes)
 int
 OpenFile::ReadAt(char *into, int numBytes, int position)
 {
-    int fileLength = hdr->FileLength();
-    int i, firstSector, lastSector, numSectors;
-    char *buf;
+    int fileLength;
+    int firstSector, lastSector, headBytes, tailBytes, whole;
+    char staging[SectorSize];
 
+    Flush();
+    fileLength = hdr->FileLength();
     if ((numBytes <= 0) || (position >= fileLength))
     	return 0; 				// check request
     if ((position + numBytes) > fileLength)		
 	numBytes = fileLength - position;
     DEBUG(dbgFile, "Reading " << numBytes << " bytes at " << position << " from file of length " << fileLength);
+    if (hdr->IsInline()) {
+	hdr->ReadInline(into, numBytes, position);
+	return numBytes;
+    }
 
     firstSector = divRoundDown(position, SectorSize);
     lastSector = divRoundDown(position + numBytes - 1, SectorSize);
-    numSectors = 1 + lastSector - firstSector;
-
-    // read in all the full and partial sectors that we need
-    buf = new char[numSectors * SectorSize];
-    for (i = firstSector; i <= lastSector; i++)	
-        kernel->synchDisk->ReadSector(hdr->ByteToSector(i * SectorSize), 
-					&buf[(i - firstSector) * SectorSize]);
+    SplitTransfer(position, numBytes, &headBytes, &tailBytes);
+    whole = (numBytes - headBytes - tailBytes) / SectorSize;
 
-    // copy the part we want
-    bcopy(&buf[position - (firstSector * SectorSize)], into, numBytes);
-    delete [] buf;
+    if (headBytes > 0) {
+	ReadSectors(firstSector, 1, staging);
+	bcopy(&staging[position - firstSector * SectorSize], into, headBytes);
+    }
+    if (whole > 0)
+	ReadSectors(divRoundUp(position, SectorSize), whole, into + headBytes);
+    if (tailBytes > 0) {
+	ReadSectors(lastSector, 1, staging);
+	bcopy(staging, into + numBytes - tailBytes, tailBytes);
+    }
     return numBytes;
 }
 
 int
 OpenFile::WriteAt(char *from, int numBytes, int position)
 {
-    int fileLength = hdr->FileLength();
-    int i, firstSector, lastSector, numSectors;
-    bool firstAligned, lastAligned;
-    char *buf;
+    int fileLength;
+    int firstSector, lastSector, numSectors, headBytes, tailBytes, whole;
+    int filled;
+    char head[SectorSize], tail[SectorSize];
 
-    if ((numBytes <= 0) || (position >= fileLength))
+    Flush();
+    fileLength = hdr->FileLength();
+    if (numBytes <= 0)
 	return 0;				// check request
+    if ((position + numBytes) > fileLength
+		&& kernel->fileSystem->ExtendFile(this, position + numBytes)) {
+	if (position > fileLength)		// zero the gap
+	    ZeroGap(fileLength, position);
+	fileLength = hdr->FileLength();
+    }
+    if (position >= fileLength)
+	return 0;				// no room to grow
     if ((position + numBytes) > fileLength)
 	numBytes = fileLength - position;
     DEBUG(dbgFile, "Writing " << numBytes << " bytes at " << position << " from file of length " << fileLength);
+    if (hdr->IsInline()) {
+	hdr->WriteInline(from, numBytes, position);
+	hdr->WriteBack(hdr_num);
+	return numBytes;
+    }
 
     firstSector = divRoundDown(position, SectorSize);
     lastSector = divRoundDown(position + numBytes - 1, SectorSize);
     numSectors = 1 + lastSector - firstSector;
-
-    buf = new char[numSectors * SectorSize];
-	
-	// Mp4 mod tag
-	memset(buf, 0, sizeof(char) * numSectors * SectorSize); // dummy operation to keep valgrind happy
-
-    firstAligned = (position == (firstSector * SectorSize));
-    lastAligned = ((position + numBytes) == ((lastSector + 1) * SectorSize));
+    SplitTransfer(position, numBytes, &headBytes, &tailBytes);
+    whole = (numBytes - headBytes - tailBytes) / SectorSize;
 
 // read in first and last sector, if they are to be partially modified
-    if (!firstAligned)
-        ReadAt(buf, SectorSize, firstSector * SectorSize);	
-    if (!lastAligned && ((firstSector != lastSector) || firstAligned))
-        ReadAt(&buf[(lastSector - firstSector) * SectorSize], 
-				SectorSize, lastSector * SectorSize);	
-
-// copy in the bytes we want to change 
-    bcopy(from, &buf[position - (firstSector * SectorSize)], numBytes);
-   //DEBUG(dbgFile, "before enter");
-// write modified sectors back
-    for (i = firstSector; i <= lastSector; i++)	
-        kernel->synchDisk->WriteSector(hdr->ByteToSector(i * SectorSize), 
-					&buf[(i - firstSector) * SectorSize]);
-    //DEBUG(dbgFile, "after enter");
-    delete [] buf;
+    if (headBytes > 0)
+	ReadSectors(firstSector, 1, head);
+    if (tailBytes > 0)
+	ReadSectors(lastSector, 1, tail);
 
+// give the holes some disk space
+    if (HasHoles(firstSector, lastSector)) {
+	filled = kernel->fileSystem->FillFile(this, firstSector, numSectors);
+	if (filled == 0)
+	    return 0;				// no room on disk
+	if (filled < numSectors) {		// cut short, at a sector end
+	    numBytes = (firstSector + filled) * SectorSize - position;
+	    lastSector = firstSector + filled - 1;
+	    SplitTransfer(position, numBytes, &headBytes, &tailBytes);
+	    whole = (numBytes - headBytes - tailBytes) / SectorSize;
+	}
+    }
+
+// copy in the bytes we want to change, and write the sectors back
+    if (headBytes > 0) {
+	bcopy(from, &head[position - firstSector * SectorSize], headBytes);
+	WriteSectors(firstSector, 1, head);
+    }
+    if (whole > 0)
+	WriteSectors(divRoundUp(position, SectorSize), whole, from + headBytes);
+    if (tailBytes > 0) {
+	bcopy(from + numBytes - tailBytes, tail, tailBytes);
+	WriteSectors(lastSector, 1, tail);
+    }
     return numBytes;
 }
 
+//----------------------------------------------------------------------
+// OpenFile::SplitTransfer
+// 	Split a transfer of "numBytes" at "position" into a partial first
+//	sector, whole sectors, and a partial last sector, setting
+//	"*headBytes" and "*tailBytes" to the number of bytes in the two
+//	partial sectors (0 if the transfer starts, or ends, on a sector
+//	boundary).  A transfer within one sector is all head.
+//----------------------------------------------------------------------
+
+void
+OpenFile::SplitTransfer(int position, int numBytes, int *headBytes, int *tailBytes)
+{
+    int offset = position % SectorSize;
+
+    *headBytes = 0;
+    if (offset != 0 || numBytes < SectorSize)
+	*headBytes = min(numBytes, SectorSize - offset);
+    *tailBytes = 0;
+    if (*headBytes < numBytes)
+	*tailBytes = (position + numBytes) % SectorSize;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ReadSectors/WriteSectors
+// 	Transfer "count" whole sectors of the file, from sector "first"
+//	on, with one disk request for each run of physically contiguous
+//	sectors.  Holes read as zeroes; there must be none to write.
+//----------------------------------------------------------------------
+
+void
+OpenFile::ReadSectors(int first, int count, char *into)
+{
+    int i, run;
+
+    for (i = first; i < first + count; i += run) {
+	run = RunLength(i, first + count - 1);
+	if (SectorOf(i * SectorSize) == -1)	// a hole
+	    memset(&into[(i - first) * SectorSize], 0, run * SectorSize);
+	else
+	    kernel->synchDisk->ReadSectors(SectorOf(i * SectorSize), run,
+					&into[(i - first) * SectorSize]);
+    }
+}
+
+void
+OpenFile::WriteSectors(int first, int count, char *from)
+{
+    int i, run;
+
+    for (i = first; i < first + count; i += run) {
+	run = RunLength(i, first + count - 1);
+	ASSERT(SectorOf(i * SectorSize) != -1);
+	kernel->synchDisk->WriteSectors(SectorOf(i * SectorSize), run,
+					&from[(i - first) * SectorSize]);
+    }
+}
+
+//----------------------------------------------------------------------
+// OpenFile::RunLength
+// 	Return how many of the file's sectors, starting with sector
+//	"fileSector" and going no further than "lastSector", are stored
+//	in consecutive disk sectors, so that they can be transferred with
+//	a single disk request.  If "fileSector" is in a hole, return how
+//	many sectors from it on are holes.
+//----------------------------------------------------------------------
+
+int
+OpenFile::RunLength(int fileSector, int lastSector)
+{
+    int first = SectorOf(fileSector * SectorSize);
+    int step = (first == -1) ? 0 : 1;
+    int run = 1;
+
+    while (fileSector + run <= lastSector 
+		&& SectorOf((fileSector + run) * SectorSize) == first + step * run)
+	run++;
+    return run;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::HasHoles
+// 	Return TRUE if any of the file's sectors from "firstSector" to
+//	"lastSector" is a hole.
+//----------------------------------------------------------------------
+
+bool
+OpenFile::HasHoles(int firstSector, int lastSector)
+{
+    for (int i = firstSector; i <= lastSector; i++)
+	if (SectorOf(i * SectorSize) == -1)
+	    return TRUE;
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ZeroGap
+// 	Zero the bytes from "from" to "to" of a file that has just been
+//	made longer.  Holes read as zeroes already, so only sectors that
+//	were allocated ahead of being written need it; the rest of the
+//	gap stays a hole.
+//----------------------------------------------------------------------
+
+void
+OpenFile::ZeroGap(int from, int to)
+{
+    char zeroes[SectorSize];
+    int i, lo, hi;
+
+    memset(zeroes, 0, SectorSize);
+    for (i = from / SectorSize; i * SectorSize < to; i++) {
+	if (!hdr->IsInline() && SectorOf(i * SectorSize) == -1)
+	    continue;
+	lo = max(from, i * SectorSize);
+	hi = min(to, (i + 1) * SectorSize);
+	WriteAt(zeroes, hi - lo, lo);
+    }
+}
+
 //----------------------------------------------------------------------
 // OpenFile::Length
-// 	Return the number of bytes in the file.
+// 	Return the number of bytes in the file, counting any gathered
+//	from small Writes (which are written out first).
 //----------------------------------------------------------------------
 
 int
 OpenFile::Length() 
 { 
+    Flush();
     return hdr->FileLength(); 
 }
 
+//----------------------------------------------------------------------
+// OpenFileTable::OpenFileTable
+// 	Initialize an empty table.
+//----------------------------------------------------------------------
+
+OpenFileTable::OpenFileTable()
+{
+    static char lockName[] = "open file table lock";
+    static char loadedName[] = "open file table loaded";
+
+    for (int i = 0; i < NumHeaderBuckets; i++)
+	buckets[i] = NULL;
+    idle = new List<OpenHeader *>;
+    lock = new Lock(lockName);
+    loaded = new Condition(loadedName);
+}
+
+//----------------------------------------------------------------------
+// OpenFileTable::~OpenFileTable
+// 	De-allocate the table.  Files still open at this point (by user
+//	programs that never closed them) are simply forgotten.
+//----------------------------------------------------------------------
+
+OpenFileTable::~OpenFileTable()
+{
+    OpenHeader *entry;
+
+    for (int i = 0; i < NumHeaderBuckets; i++)
+	while (buckets[i] != NULL) {
+	    entry = buckets[i];
+	    buckets[i] = entry->hashNext;
+	    delete entry->hdr;
+	    delete entry;
+	}
+    delete idle;
+    delete lock;
+    delete loaded;
+}
+
+//----------------------------------------------------------------------
+// OpenFileTable::Find
+// 	Return the entry for the header at "sector", or NULL if it is
+//	not in core.
+//----------------------------------------------------------------------
+
+OpenHeader *
+OpenFileTable::Find(int sector)
+{
+    OpenHeader *entry = buckets[sector % NumHeaderBuckets];
+
+    while (entry != NULL && entry->sector != sector)
+	entry = entry->hashNext;
+    return entry;
+}
+
+//----------------------------------------------------------------------
+// OpenFileTable::Unhash
+// 	Take an entry out of its hash chain, and free it and its header.
+//	Nobody may be using it.  The caller holds the table lock.
+//----------------------------------------------------------------------
+
+void
+OpenFileTable::Unhash(OpenHeader *entry)
+{
+    OpenHeader **ptr = &buckets[entry->sector % NumHeaderBuckets];
+
+    ASSERT(entry->refCount == 0);
+    while (*ptr != entry) {
+	ASSERT(*ptr != NULL);		// entry must be on its chain
+	ptr = &(*ptr)->hashNext;
+    }
+    *ptr = entry->hashNext;
+    delete entry->hdr;
+    delete entry;
+}
+
+//----------------------------------------------------------------------
+// OpenFileTable::Acquire
+// 	Return the in-core header of the file whose header is at
+//	"sector", reading it in from disk if it is not in core yet,
+//	and count one more reference to it.
+//
+//	The entry is put in the table, holding our reference, before
+//	the header is read, and the lock is let go during the read.
+//	Anyone else opening the file in the meantime finds the entry
+//	and waits for the read to finish.
+//----------------------------------------------------------------------
+
+FileHeader *
+OpenFileTable::Acquire(int sector)
+{
+    OpenHeader *entry;
+    FileHeader *hdr;
+
+    lock->Acquire();
+    entry = Find(sector);
+    if (entry == NULL) {
+	kernel->stats->numHeaderMisses++;
+	entry = new OpenHeader;
+	entry->sector = sector;
+	entry->hdr = new FileHeader;
+	entry->refCount = 1;
+	entry->loading = TRUE;
+	entry->removed = FALSE;
+	entry->hashNext = buckets[sector % NumHeaderBuckets];
+	buckets[sector % NumHeaderBuckets] = entry;
+	lock->Release();
+	entry->hdr->FetchFrom(sector);	// may wait for the disk
+	lock->Acquire();
+	entry->loading = FALSE;
+	loaded->Broadcast(lock);
+    } else {
+	kernel->stats->numHeaderHits++;
+	if (entry->refCount == 0)
+	    idle->Remove(entry);	// in use again
+	entry->refCount++;
+	while (entry->loading)
+	    loaded->Wait(lock);
+    }
+    DEBUG(dbgFile, "Header " << sector << " open " << entry->refCount << " times");
+    hdr = entry->hdr;
+    lock->Release();
+    return hdr;
+}
+
+//----------------------------------------------------------------------
+// OpenFileTable::Release
+// 	Drop one reference to the header at "sector".  When the last
+//	one goes, the header stays in core, in case the file is opened
+//	again, and the least recently used idle header is dropped if
+//	there are too many.  If the file was removed in the meantime,
+//	its header is dropped instead, and its space on disk freed.
+//----------------------------------------------------------------------
+
+void
+OpenFileTable::Release(int sector)
+{
+    OpenHeader *entry;
+
+    lock->Acquire();
+    entry = Find(sector);
+    ASSERT(entry != NULL && entry->refCount > 0 && !entry->loading);
+    if (--entry->refCount > 0) {
+	lock->Release();
+	return;
+    }
+    if (entry->removed) {
+	Unhash(entry);
+	lock->Release();
+	kernel->fileSystem->Reclaim(sector);
+	return;
+    }
+    idle->Append(entry);
+    if (idle->NumInList() > NumIdleHeaders)
+	Unhash(idle->RemoveFront());
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// OpenFileTable::MarkRemoved
+// 	The file whose header is at "sector" has been taken out of its
+//	directory.  If it is open, remember to deallocate it once it is
+//	closed for the last time, and return TRUE; return FALSE if it is
+//	not open, so the caller can deallocate it right away.  A header
+//	that is only cached is dropped, since its sector will be reused.
+//----------------------------------------------------------------------
+
+bool
+OpenFileTable::MarkRemoved(int sector)
+{
+    OpenHeader *entry;
+    bool open = FALSE;
+
+    lock->Acquire();
+    entry = Find(sector);
+    if (entry != NULL && entry->refCount == 0) {
+	idle->Remove(entry);
+	Unhash(entry);
+    } else if (entry != NULL) {
+	entry->removed = TRUE;
+	open = TRUE;
+    }
+    lock->Release();
+    return open;
+}
+
+//----------------------------------------------------------------------
+// OpenFileTable::SelfTest, SelfTestHelper
+//	Test that two threads opening a file at the same time share
+//	one in-core header.  The header is pushed out of both the table
+//	and the disk cache first, so the first thread to open the file
+//	has to wait for the disk, and the second one opens it meanwhile.
+//----------------------------------------------------------------------
+
+void
+OpenFileTable::SelfTestHelper(void *data)
+{
+    OpenFileTable *_this = (OpenFileTable *) data;
+
+    _this->selfTestHdr = _this->Acquire(_this->selfTestSector);
+    _this->selfTestDone->V();
+}
+
+void
+OpenFileTable::SelfTest()
+{
+    static const char testName[] = "/OpenFileTableTest";
+    static char helperName[] = "opener";
+    static char doneName[] = "open file table test";
+    char name[sizeof(testName)];	// taken apart by each call
+    char buf[SectorSize];
+    Thread *helper = new Thread(helperName, 1);
+    OpenFile *openFile;
+    OpenHeader *entry;
+    FileHeader *hdr;
+    bool done;
+    int count = 0;
+
+    strcpy(name, testName);
+    done = kernel->fileSystem->Create(name, 0);
+    ASSERT(done);
+    strcpy(name, testName);
+    openFile = kernel->fileSystem->Open(name);
+    ASSERT(openFile != NULL);
+    selfTestSector = openFile->get_hdr_num();
+    delete openFile;
+
+    lock->Acquire();			// drop the cached header...
+    entry = Find(selfTestSector);
+    ASSERT(entry != NULL && entry->refCount == 0);
+    idle->Remove(entry);
+    Unhash(entry);
+    lock->Release();
+    kernel->synchDisk->Sync();		// ...and the cached sector
+    for (int i = 1; i <= NumCacheEntries; i++)
+	kernel->synchDisk->ReadSector(NumSectors - i, buf);
+
+    selfTestDone = new Semaphore(doneName, 0);
+    helper->Fork((VoidFunctionPtr) OpenFileTable::SelfTestHelper, this);
+    hdr = Acquire(selfTestSector);	// waits for the disk
+    selfTestDone->P();
+
+    ASSERT(hdr == selfTestHdr);
+    for (entry = buckets[selfTestSector % NumHeaderBuckets];
+		entry != NULL; entry = entry->hashNext)
+	if (entry->sector == selfTestSector)
+	    count++;
+    ASSERT(count == 1 && Find(selfTestSector)->refCount == 2);
+
+    Release(selfTestSector);
+    Release(selfTestSector);
+    delete selfTestDone;
+    strcpy(name, testName);
+    done = kernel->fileSystem->Remove(name);
+    ASSERT(done);
+}
+
 #endif //FILESYS_STUB
@@ -23,6 +23,7 @@
 #include "copyright.h"
 #include "utility.h"
 #include "sysdep.h"
+#include "list.h"
 
 #ifdef FILESYS_STUB			// Temporarily implement calls to 
 					// Nachos file system as calls to UNIX!
@@ -61,6 +62,17 @@ class OpenFile {
 
 #else // FILESYS
 class FileHeader;
+class PersistentBitmap;
+class Lock;
+class Condition;
+class Semaphore;
+
+// Once Read sees a file being read sequentially, it reads ahead
+// MinReadAhead sectors, doubling that on every further sequential
+// Read up to MaxReadAhead; a Read anywhere else halves it again.
+
+const int MinReadAhead = 4;
+const int MaxReadAhead = 32;
 
 class OpenFile {
   public:
@@ -70,6 +82,7 @@ class OpenFile {
 
     void Seek(int position); 		// Set the position from which to 
 					// start reading/writing -- UNIX lseek
+    int Tell() { return seekPosition; }	// Return that position
 
     int Read(char *into, int numBytes); // Read/write bytes from the file,
 					// starting at the implicit position.
@@ -81,6 +94,17 @@ class OpenFile {
     					// Read/write bytes from the file,
 					// bypassing the implicit position.
     int WriteAt(char *from, int numBytes, int position);
+					// WriteAt makes the file longer if
+					// it must
+
+    bool Extend(PersistentBitmap *freeMap, int fileSize, int chunk);
+					// Make the file "fileSize" bytes
+					// long, if it is shorter
+    bool Fill(PersistentBitmap *freeMap, int first, int count);
+					// Allocate the holes among "count"
+					// sectors from sector "first"
+    int PlaceNear(int fileSector);	// Disk sector to allocate sector
+					// "fileSector" of the file near
 
     int Length(); 			// Return the number of bytes in the
 					// file (this interface is simpler 
@@ -93,10 +117,119 @@ class OpenFile {
 		return hdr_num;
 	}
   private:
-    FileHeader *hdr;			// Header for this file 
+    FileHeader *hdr;			// Header for this file, shared with
+					// every other OpenFile of the file
     int seekPosition;			// Current position within the file
 	//TODO
 	int hdr_num; //hdr in which sector
+
+    int **blockMap;			// In-core map of resolved data sectors:
+					// blockMap[i] holds the sectors of
+					// the i-th index leaf (NumDirect file
+					// sectors), or NULL until touched
+    int numLeaves;			// Number of entries in blockMap
+    int mappedVersion;			// hdr->MapVersion() when blockMap
+					// was made
+
+    int streamEnd;			// Where the last Read ended
+    int readAhead;			// Read-ahead window, in sectors
+    int readAheadEnd;			// File sectors up to here have been
+					// read ahead already
+
+    char *pending;			// Small Writes not written out yet:
+    int pendingStart, pendingEnd;	// the bytes of the file from
+					// pendingStart up to pendingEnd,
+					// all in one sector (pending holds
+					// that sector)
+
+    void Gather(char *from, int numBytes, int position);
+					// Add a small Write to "pending"
+    void Flush();			// Write out "pending"
+
+    void ReadAhead(int position);	// Read ahead of a sequential Read
+    void ResetBlockMap();		// Empty blockMap, sized to the file
+    int SectorOf(int offset);		// ByteToSector, through blockMap
+    int RunLength(int fileSector, int lastSector);
+					// # of sectors from fileSector on
+					// that are contiguous on disk
+    void SplitTransfer(int position, int numBytes, int *headBytes,
+				int *tailBytes);
+					// How many bytes of a transfer are
+					// in partial first/last sectors?
+    void ReadSectors(int first, int count, char *into);
+    void WriteSectors(int first, int count, char *from);
+					// Transfer whole sectors of the file
+    bool HasHoles(int firstSector, int lastSector);
+					// Are any of those sectors holes?
+    void ZeroGap(int from, int to);	// Zero a gap left by growing the
+					// file, except where it is a hole
+};
+
+// The system-wide open file table keeps the headers of files nobody
+// has open in core as well, up to NumIdleHeaders of them, so that
+// opening a file again -- or walking through a directory again --
+// does not read its header again.  They are dropped least recently
+// used first.
+
+const int NumIdleHeaders = 64;		// # of unused headers kept in core
+const int NumHeaderBuckets = 61;	// # of hash chains (prime)
+
+// The following class defines one entry of the system-wide open file
+// table: the in-core copy of a file header, and how many OpenFiles
+// are using it.  A file removed while it is still open keeps its
+// header and data until the last OpenFile of it is closed.  An entry
+// goes into the table before its header is read in, marked "loading",
+// so that a second thread opening the same file waits for that read
+// instead of starting another copy of the header.
+
+class OpenHeader {
+  public:
+    int sector;				// Where the header lives on disk
+    FileHeader *hdr;			// The in-core copy
+    int refCount;			// # of OpenFiles using it; 0 if it
+					// is only cached
+    bool loading;			// Is hdr still being read in?
+    bool removed;			// Deallocate on the last close?
+    OpenHeader *hashNext;		// Next entry in the same hash chain
+};
+
+// The following class defines the system-wide open file table.  Every
+// OpenFile of the same file shares one in-core FileHeader, so that a
+// file grown through one of them is seen at its new size through all
+// the others.  Every change to a header is made to the shared copy,
+// and written through to disk, so a cached header is never stale.
+
+class OpenFileTable {
+  public:
+    OpenFileTable();			// Initialize an empty table
+    ~OpenFileTable();			// De-allocate the table
+
+    FileHeader *Acquire(int sector);	// Return the header at "sector",
+					// reading it in if it is not in
+					// core yet
+    void Release(int sector);		// Drop one reference to it
+    bool MarkRemoved(int sector);	// If the file is open, defer its
+					// deallocation to the last close
+
+    void SelfTest();			// Test that two threads opening
+					// the same file share its header
+
+  private:
+    OpenHeader *buckets[NumHeaderBuckets];
+					// Headers in core, hashed by sector
+    List<OpenHeader *> *idle;		// Those nobody has open, least
+					// recently used first
+    Lock *lock;				// Protects the table
+    Condition *loaded;			// Signalled when a header has been
+					// read in
+    OpenHeader *Find(int sector);	// Entry for "sector", or NULL
+    void Unhash(OpenHeader *entry);	// Take an entry out of the table
+					// and free it
+
+    static void SelfTestHelper(void *data);
+    int selfTestSector;			// Header both threads open
+    FileHeader *selfTestHdr;		// What the helper thread got
+    Semaphore *selfTestDone;		// The helper thread has it open
 };
 
 #endif // FILESYS
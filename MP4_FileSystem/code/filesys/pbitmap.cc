@@ -8,6 +8,11 @@
 
 #include "copyright.h"
 #include "pbitmap.h"
+#include "disk.h"
+
+// Sectors per block group.  A group is a whole number of words of the
+// map, so that it can be searched a word at a time.
+static const int GroupSectors = GroupTracks * SectorsPerTrack;
 
 //----------------------------------------------------------------------
 // PersistentBitmap::PersistentBitmap(int)
@@ -16,11 +21,14 @@
 //
 //	"numItems" is the number of bits in the bitmap.
 //
-//      This constructor does not initialize the bitmap from a disk file
+//      This constructor does not initialize the bitmap from a disk file,
+//	so all of it counts as changed.
 //----------------------------------------------------------------------
 
 PersistentBitmap::PersistentBitmap(int numItems):Bitmap(numItems) 
 { 
+    InitDirty(TRUE);
+    InitGroups();
 }
 
 //----------------------------------------------------------------------
@@ -41,6 +49,9 @@ PersistentBitmap::PersistentBitmap(OpenFile *file, int numItems):Bitmap(numItems
     // but we will just overwrite that with the contents of the
     // map found in the file
     file->ReadAt((char *)map, numWords * sizeof(unsigned), 0);
+    Recount();
+    InitDirty(FALSE);
+    InitGroups();
 }
 
 //----------------------------------------------------------------------
@@ -50,6 +61,421 @@ PersistentBitmap::PersistentBitmap(OpenFile *file, int numItems):Bitmap(numItems
 
 PersistentBitmap::~PersistentBitmap()
 { 
+    delete [] dirty;
+    delete [] groupFree;
+    delete [] tree;
+    delete [] stale;
+    delete [] isStale;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::InitDirty
+// 	Set up the table of changed sectors, with every sector of the
+//	bitmap file marked changed (or not).
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::InitDirty(bool changed)
+{
+    numSectors = divRoundUp(numWords * sizeof(unsigned), SectorSize);
+    dirty = new bool[numSectors];
+    for (int i = 0; i < numSectors; i++)
+	dirty[i] = changed;
+    numDirty = changed ? numSectors : 0;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::Dirty
+// 	Note that the sector of the bitmap file holding bit "which" has
+//	to be written back.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::Dirty(int which)
+{
+    int sector = which / (SectorSize * BitsInByte);
+
+    if (!dirty[sector]) {
+	dirty[sector] = TRUE;
+	numDirty++;
+    }
+}
+
+//----------------------------------------------------------------------
+// Combine
+// 	Fill in a node of the summary tree from its two children.
+//----------------------------------------------------------------------
+
+static void
+Combine(GroupSummary *node, GroupSummary *left, GroupSummary *right)
+{
+    node->size = left->size + right->size;
+    node->longest = max(left->longest, right->longest);
+    node->prefix = left->prefix;
+    if (left->prefix == left->size)
+	node->prefix += right->prefix;
+    node->suffix = right->suffix;
+    if (right->suffix == right->size)
+	node->suffix += left->suffix;
+    node->best = max(max(left->best, right->best), 
+			left->suffix + right->prefix);
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::InitGroups
+// 	Set up the table of free sectors per block group and the summary
+//	tree over it, and fill them in.  There is no goal to begin with.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::InitGroups()
+{
+    ASSERT(GroupSectors % BitsInWord == 0);
+    numGroups = divRoundUp(numBits, GroupSectors);
+    groupFree = new int[numGroups];
+    for (numLeaves = 1; numLeaves < numGroups; numLeaves *= 2)
+	;
+    tree = new GroupSummary[2 * numLeaves];
+    stale = new int[numGroups];
+    isStale = new bool[numGroups];
+    CountGroups();
+    goal = -1;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::CountGroups
+// 	Count the free sectors in each block group, a word at a time,
+//	and build the summary tree from the bottom up.  Must be called
+//	whenever "map" is overwritten wholesale.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::CountGroups()
+{
+    int g, node;
+
+    for (g = 0; g < numGroups; g++) {
+	groupFree[g] = 0;
+	isStale[g] = FALSE;
+    }
+    numStale = 0;
+    for (int w = 0; w < numWords; w++)
+	groupFree[w * BitsInWord / GroupSectors] += 
+		BitsInWord - __builtin_popcount(map[w]);
+
+    for (g = 0; g < numLeaves; g++) {
+	GroupSummary *leaf = &tree[numLeaves + g];
+	bool whole = (g < numGroups && groupFree[g] == GroupSectors);
+
+	leaf->size = 1;
+	leaf->longest = (g < numGroups) ? LongestRun(g) : 0;
+	leaf->prefix = leaf->suffix = leaf->best = whole ? 1 : 0;
+    }
+    for (node = numLeaves - 1; node >= 1; node--)
+	Combine(&tree[node], &tree[2 * node], &tree[2 * node + 1]);
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::Changed
+// 	Note that a bit of a group has changed, so that its part of the
+//	summary is recomputed before the next search -- once, however
+//	many of its bits changed in the meantime.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::Changed(int group)
+{
+    if (!isStale[group]) {
+	isStale[group] = TRUE;
+	stale[numStale++] = group;
+    }
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::Refresh
+// 	Bring the summary up to date with every group changed since the
+//	last search.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::Refresh()
+{
+    for (int i = 0; i < numStale; i++) {
+	isStale[stale[i]] = FALSE;
+	Summarize(stale[i]);
+    }
+    numStale = 0;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::Summarize
+// 	Recompute the leaf of the summary tree for a group, and every
+//	node on the way up to the root.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::Summarize(int group)
+{
+    int node = numLeaves + group;
+    GroupSummary *leaf = &tree[node];
+
+    leaf->longest = LongestRun(group);
+    leaf->prefix = leaf->suffix = leaf->best = 
+		(groupFree[group] == GroupSectors) ? 1 : 0;
+    for (node /= 2; node >= 1; node /= 2)
+	Combine(&tree[node], &tree[2 * node], &tree[2 * node + 1]);
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::LongestRun
+// 	Return the length of the longest run of clear bits within a
+//	group.  Whole words are handled at once, as in ScanRun.
+//----------------------------------------------------------------------
+
+int
+PersistentBitmap::LongestRun(int group)
+{
+    int first = group * GroupSectors / BitsInWord;
+    int last = min(numWords, first + GroupSectors / BitsInWord);
+    int run = 0, longest = 0;
+
+    if (groupFree[group] == 0)
+	return 0;
+    for (int word = first; word < last; word++) {
+	unsigned int bits = map[word];
+
+	if (bits == 0) {
+	    run += BitsInWord;
+	} else if (bits == ~0u) {
+	    run = 0;
+	} else {
+	    for (int bit = 0; bit < BitsInWord; bit++) {
+		if (bits & (1u << bit)) {
+		    run = 0;
+		} else {
+		    run++;
+		    longest = max(longest, run);
+		}
+	    }
+	}
+	longest = max(longest, run);
+    }
+    return longest;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::Mark/Clear
+// 	Set or clear the "nth" bit, keep the count of its block group,
+//	and remember that the sector of the bitmap file holding it has
+//	to be written back, and that the summary of its group is out of
+//	date.
+//
+//	"which" is the number of the bit
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::Mark(int which)
+{
+    if (!Test(which))
+	groupFree[which / GroupSectors]--;
+    Bitmap::Mark(which);
+    Dirty(which);
+    Changed(which / GroupSectors);
+}
+
+void
+PersistentBitmap::Clear(int which)
+{
+    if (Test(which))
+	groupFree[which / GroupSectors]++;
+    Bitmap::Clear(which);
+    Dirty(which);
+    Changed(which / GroupSectors);
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::FindAndSet
+// 	Return the number of a clear bit, and set it: the first one after
+//	the goal in its group, or else in the nearest group with one.
+//	Without a goal, the search goes on from where the last one ended.
+//
+//	If no bits are clear, return -1.
+//----------------------------------------------------------------------
+
+int
+PersistentBitmap::FindAndSet()
+{
+    int which = FindRun(1);
+
+    if (which != -1)
+	Mark(which);
+    return which;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::FindRun
+// 	Return the number of the first bit of a run of "count" clear
+//	bits.  The summary tree picks the group: with a goal, the group
+//	nearest the goal's that has such a run; without one, the first
+//	such group from where the last search ended, wrapping around.
+//	The run is then looked for in that group, from the goal (or the
+//	last search) on if it is the goal's group.  A run longer than a
+//	group is made of wholly free groups.  The bits are not set.
+//
+//	Runs that straddle two groups, but fit in neither, are not found;
+//	the caller settles for a shorter run instead (see ExtentAllocator).
+//
+//	If there is no such run, return -1.
+//
+//	"count" is the number of consecutive clear bits wanted
+//----------------------------------------------------------------------
+
+int
+PersistentBitmap::FindRun(int count)
+{
+    int from, home, after, before, group, start;
+
+    ASSERT(count > 0);
+    if (count > numClear)
+	return -1;
+    Refresh();
+    if (count > GroupSectors) {
+	group = FindFreeGroups(divRoundUp(count, GroupSectors));
+	return (group == -1) ? -1 : group * GroupSectors;
+    }
+
+    from = (goal == -1) ? nextFit : goal;
+    home = from / GroupSectors;
+    after = FindGroupAfter(home, count);
+    if (goal == -1)			// wrap around
+	before = (after == -1) ? FindGroupAfter(0, count) : -1;
+    else
+	before = FindGroupBefore(home - 1, count);
+    if (after == -1 && before == -1)
+	return -1;
+    if (after == -1 || (before != -1 && home - before < after - home))
+	group = before;
+    else
+	group = after;
+
+    start = FindRunInGroup(group, count, 
+		(group == home) ? from : group * GroupSectors);
+    ASSERT(start != -1);		// the summary said there was one
+    if (goal == -1)
+	nextFit = (start + count) % numBits;
+    return start;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::FindGroupAfter
+// 	Return the first group from "group" on with a free run of at
+//	least "count" sectors, or -1.  Climb from the group's leaf until
+//	a right sibling has one, then go down to its leftmost such leaf.
+//----------------------------------------------------------------------
+
+int
+PersistentBitmap::FindGroupAfter(int group, int count)
+{
+    int node;
+
+    if (group < 0 || group >= numGroups)
+	return -1;
+    node = numLeaves + group;
+    if (tree[node].longest >= count)
+	return group;
+    while (node > 1 && !(node % 2 == 0 && tree[node + 1].longest >= count))
+	node /= 2;
+    if (node == 1)
+	return -1;
+    node++;				// the right sibling has one
+    while (node < numLeaves) {
+	node *= 2;
+	if (tree[node].longest < count)
+	    node++;
+    }
+    return node - numLeaves;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::FindGroupBefore
+// 	Return the last group at or before "group" with a free run of at
+//	least "count" sectors, or -1; the mirror image of FindGroupAfter.
+//----------------------------------------------------------------------
+
+int
+PersistentBitmap::FindGroupBefore(int group, int count)
+{
+    int node;
+
+    if (group < 0 || group >= numGroups)
+	return -1;
+    node = numLeaves + group;
+    if (tree[node].longest >= count)
+	return group;
+    while (node > 1 && !(node % 2 == 1 && tree[node - 1].longest >= count))
+	node /= 2;
+    if (node == 1)
+	return -1;
+    node--;				// the left sibling has one
+    while (node < numLeaves) {
+	node = 2 * node + 1;
+	if (tree[node].longest < count)
+	    node--;
+    }
+    return node - numLeaves;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::FindFreeGroups
+// 	Return the first of the first "count" wholly free groups in a
+//	row, or -1.  Go down the tree: into the left child if the stretch
+//	fits there, else across the middle if it fits there, else into
+//	the right child.
+//----------------------------------------------------------------------
+
+int
+PersistentBitmap::FindFreeGroups(int count)
+{
+    int node = 1, first = 0;		// "first" is node's first group
+    GroupSummary *left, *right;
+
+    if (tree[1].best < count)
+	return -1;
+    while (node < numLeaves) {
+	left = &tree[2 * node];
+	right = &tree[2 * node + 1];
+	if (left->best >= count) {
+	    node = 2 * node;
+	} else if (left->suffix + right->prefix >= count) {
+	    return first + left->size - left->suffix;
+	} else {
+	    first += left->size;
+	    node = 2 * node + 1;
+	}
+    }
+    return first;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::FindRunInGroup
+// 	Look for a run of "count" clear bits inside one block group,
+//	from bit "from" to the end of the group, then from the start of
+//	the group.  Return its first bit, or -1.
+//----------------------------------------------------------------------
+
+int
+PersistentBitmap::FindRunInGroup(int group, int count, int from)
+{
+    int first = group * GroupSectors / BitsInWord;
+    int last = min(numWords, first + GroupSectors / BitsInWord);
+    int fromWord = max(first, min(last - 1, from / BitsInWord));
+    int start;
+
+    start = ScanRun(fromWord, last, count);
+    if (start == -1 && fromWord > first)
+	start = ScanRun(first, min(last, 
+			fromWord + divRoundUp(count, BitsInWord) + 1), count);
+    return start;
 }
 
 //----------------------------------------------------------------------
@@ -63,11 +489,19 @@ void
 PersistentBitmap::FetchFrom(OpenFile *file) 
 {
     file->ReadAt((char *)map, numWords * sizeof(unsigned), 0);
+    Recount();
+    CountGroups();
+    for (int i = 0; i < numSectors; i++)
+	dirty[i] = FALSE;
+    numDirty = 0;
 }
 
 //----------------------------------------------------------------------
 // PersistentBitmap::WriteBack
 // 	Store the contents of a persistent bitmap to a Nachos file.
+//	Only the sectors of the file holding bits that changed since the
+//	last FetchFrom or WriteBack are written, each run of them with
+//	one WriteAt.
 //
 //	"file" is the place to write the bitmap to
 //----------------------------------------------------------------------
@@ -75,5 +509,20 @@ PersistentBitmap::FetchFrom(OpenFile *file)
 void
 PersistentBitmap::WriteBack(OpenFile *file)
 {
-   file->WriteAt((char *)map, numWords * sizeof(unsigned), 0);
+    int size = numWords * sizeof(unsigned);
+    int first, last, offset;
+
+    for (first = 0; first < numSectors; first = last) {
+	if (!dirty[first]) {
+	    last = first + 1;
+	    continue;
+	}
+	for (last = first; last < numSectors && dirty[last]; last++) {
+	    dirty[last] = FALSE;
+	    numDirty--;
+	}
+	offset = first * SectorSize;
+	file->WriteAt((char *)map + offset, 
+			min(last * SectorSize, size) - offset, offset);
+    }
 }
@@ -20,6 +20,41 @@
 // The following class defines a persistent bitmap.  It inherits all
 // the behavior of a bitmap (see bitmap.h), adding the ability to
 // be read from and stored to the disk.
+//
+// The bitmap remembers which sectors of its file hold bits that have
+// changed since it was last fetched or written back, and WriteBack
+// only writes those.
+//
+// The disk is divided into block groups of GroupTracks whole tracks,
+// and the bitmap keeps count of the free sectors in each.  Once it is
+// given a goal, it allocates in the goal's group if there is room, and
+// otherwise in the nearest group that has room, so that what belongs
+// together -- a file's header, index and data, and its directory --
+// stays within a few tracks, and seeks between them stay short.
+//
+// So that finding free space does not mean scanning the map, however
+// full the disk is, the groups are summarized in a tree: each node
+// covers a range of groups, and records the longest free run inside
+// any one of them, and the longest stretch of wholly free groups.  A
+// search walks down the tree to a group that has what it needs, and
+// only that group's part of the map is looked at; so it takes time
+// logarithmic in the size of the disk.  The summary is not kept on
+// disk, but rebuilt whenever the map is read in.
+
+const int GroupTracks = 32;		// tracks per block group
+
+// The following class defines one node of the summary tree, covering
+// "size" consecutive groups.
+
+class GroupSummary {
+  public:
+    int size;				// # of groups covered
+    int longest;			// Longest free run within one group
+    int prefix;				// # of wholly free groups at the
+    int suffix;				//  start/end of the range
+    int best;				// Longest stretch of wholly free
+					//  groups anywhere in the range
+};
 
 class PersistentBitmap : public Bitmap {
   public:
@@ -28,8 +63,53 @@ class PersistentBitmap : public Bitmap {
 
     ~PersistentBitmap(); 			// deallocate bitmap
 
+    void Mark(int which);		// Set/clear the "nth" bit, and
+    void Clear(int which);		// note its sector as changed
+
+    int FindAndSet();			// Find (and set) a clear bit, or
+    int FindRun(int count);		// a run of clear bits, near the goal
+    void SetGoal(int sector) { goal = sector; }
+					// Allocate near "sector" from now on
+					// (-1: anywhere, by next fit)
+
     void FetchFrom(OpenFile *file);     // read bitmap from the disk
-    void WriteBack(OpenFile *file); 	// write bitmap contents to disk 
+    void WriteBack(OpenFile *file); 	// write changed sectors to disk 
+    int NumDirty() { return numDirty; }	// # of sectors WriteBack would
+					// write
+
+  private:
+    int numSectors;			// # of sectors in the bitmap file
+    bool *dirty;			// which of them have changed
+    int numDirty;			// and how many
+
+    int numGroups;			// # of block groups on the disk
+    int *groupFree;			// # of free sectors in each
+    int goal;				// sector to allocate near, or -1
+
+    GroupSummary *tree;			// The summary: node 1 is the root,
+					// node n has children 2n and 2n+1,
+    int numLeaves;			// and group g is node numLeaves + g
+    int *stale;				// Groups changed since the summary
+    int numStale;			//  was last brought up to date
+    bool *isStale;			// Is a group on that list?
+
+    void InitDirty(bool changed);	// Mark every sector clean/changed
+    void Dirty(int which);		// Note the sector of a bit changed
+    void InitGroups();			// Make the table of free sectors per
+    void CountGroups();			// group and the summary, and count
+    void Changed(int group);		// Note that a group has changed
+    void Refresh();			// Bring the summary up to date
+    void Summarize(int group);		// Recompute a group's leaf, and the
+					// nodes above it
+    int LongestRun(int group);		// Longest free run in a group
+    int FindGroupAfter(int group, int count);
+    int FindGroupBefore(int group, int count);
+					// Nearest group from/before "group"
+					// with a run of "count" free sectors
+    int FindFreeGroups(int count);	// First of "count" wholly free
+					// groups in a row
+    int FindRunInGroup(int group, int count, int from);
+					// Look for a run within a group
 };
 
 #endif // PBITMAP_H
@@ -1,54 +1,141 @@
-// synchdisk.cc 
-//	Routines to synchronously access the disk.  The physical disk 
+// synchdisk.cc
+//	Routines to synchronously access the disk.  The physical disk
 //	is an asynchronous device (disk requests return immediately, and
 //	an interrupt happens later on).  This is a layer on top of
 //	the disk providing a synchronous interface (requests wait until
 //	the request completes).
 //
-//	Use a semaphore to synchronize the interrupt handlers with the
-//	pending requests.  And, because the physical disk can only
-//	handle one operation at a time, use a lock to enforce mutual
-//	exclusion.
+//	Each request waits on a semaphore of its own, which the disk
+//	interrupt handler signals.  Because the physical disk can only
+//	handle one operation at a time, requests that arrive while it is
+//	busy are queued, and the interrupt handler starts the next one,
+//	chosen by the scheduling policy.  The queue is manipulated with
+//	interrupts disabled, since the interrupt handler cannot wait for
+//	a lock.
+//
+//	Every sector passes through a write-back buffer cache.  Cached
+//	sectors are found through a hash table keyed by sector number,
+//	and kept on a doubly-linked list in least-recently-used order; when
+//	a new sector must be brought in, the least recently used entry
+//	that is not busy is reused, writing it back first if it is dirty.
+//	A lock protects the cache.  It is released while a thread waits
+//	for the disk; the entries involved are marked busy in the
+//	meantime, and anyone else needing them waits on a condition.
+//
+//	Sectors can also be read ahead: ReadAhead claims entries for them
+//	and issues the disk request, but does not wait for it.  Since the
+//	interrupt handler cannot take the lock, the data is moved into
+//	the cache later, by whichever thread first needs one of the
+//	entries or notices that the request has completed.
+//
+//	When a journal is attached, sectors written inside a transaction
+//	are pinned in the cache until the journal has logged them; the
+//	Journal routines are at the end of this file.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
-// All rights reserved.  See copyright.h for copyright notice and limitation 
+// All rights reserved.  See copyright.h for copyright notice and limitation
 // of liability and disclaimer of warranty provisions.
 
 #include "copyright.h"
 #include "synchdisk.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// DiskRequest::DiskRequest
+// 	Set up a request for "count" sectors starting at "sectorNumber".
+//----------------------------------------------------------------------
 
+DiskRequest::DiskRequest(int sectorNumber, char *buffer, int count,
+				bool isWrite)
+{
+    static char doneName[] = "disk request";
+
+    sector = sectorNumber;
+    numSectors = count;
+    data = buffer;
+    writing = isWrite;
+    track = sectorNumber / SectorsPerTrack;
+    issued = 0;
+    completed = FALSE;
+    done = new Semaphore(doneName, 0);
+}
+
+DiskRequest::~DiskRequest()
+{
+    delete done;
+}
 
 //----------------------------------------------------------------------
 // SynchDisk::SynchDisk
 // 	Initialize the synchronous interface to the physical disk, in turn
-//	initializing the physical disk.
+//	initializing the physical disk.  The cache starts out empty, with
+//	every entry on the LRU list.
 //
+//	"policy" -- the order in which queued requests are served
+//	"mapped" -- should the raw disk map its UNIX file into memory?
 //----------------------------------------------------------------------
 
-SynchDisk::SynchDisk()
+SynchDisk::SynchDisk(DiskSchedPolicy policy, bool mapped)
 {
-    semaphore = new Semaphore("synch disk", 0);
+    static char ioDoneName[] = "synch disk io";
+    int i;
+
+    this->policy = policy;
     lock = new Lock("synch disk lock");
-    disk = new Disk(this);
+    ioDone = new Condition(ioDoneName);
+    queue = new List<DiskRequest *>;
+    prefetches = new List<Prefetch *>;
+    active = NULL;
+    journal = NULL;
+    sweepUp = TRUE;
+    disk = new Disk(this, mapped);
+
+    maxLatency = 1024;
+    numLatency = 0;
+    latency = new int[maxLatency];
+
+    cache = new CacheEntry[NumCacheEntries];
+    for (i = 0; i < NumCacheBuckets; i++)
+	buckets[i] = NULL;
+    for (i = 0; i < NumCacheEntries; i++) {
+	cache[i].sector = -1;
+	cache[i].dirty = FALSE;
+	cache[i].busy = FALSE;
+	cache[i].prefetch = NULL;
+	cache[i].prefetched = FALSE;
+	cache[i].pinned = FALSE;
+	cache[i].hashNext = NULL;
+	cache[i].lruPrev = (i > 0) ? &cache[i - 1] : NULL;
+	cache[i].lruNext = (i < NumCacheEntries - 1) ? &cache[i + 1] : NULL;
+    }
+    lruHead = &cache[0];
+    lruTail = &cache[NumCacheEntries - 1];
 }
 
 //----------------------------------------------------------------------
 // SynchDisk::~SynchDisk
-// 	De-allocate data structures needed for the synchronous disk
-//	abstraction.
+// 	Flush any modified sectors still in the cache, then de-allocate
+//	data structures needed for the synchronous disk abstraction.
 //----------------------------------------------------------------------
 
 SynchDisk::~SynchDisk()
 {
+    Sync();
+    ASSERT(active == NULL && queue->IsEmpty() && prefetches->IsEmpty());
+    delete [] cache;
+    delete [] latency;
     delete disk;
+    delete queue;
+    delete prefetches;
+    delete ioDone;
     delete lock;
-    delete semaphore;
 }
 
 //----------------------------------------------------------------------
 // SynchDisk::ReadSector
 // 	Read the contents of a disk sector into a buffer.  Return only
-//	after the data has been read.
+//	after the data has been read.  If the sector is cached, no disk
+//	request is needed.
 //
 //	"sectorNumber" -- the disk sector to read
 //	"data" -- the buffer to hold the contents of the disk sector
@@ -57,16 +144,34 @@ SynchDisk::~SynchDisk()
 void
 SynchDisk::ReadSector(int sectorNumber, char* data)
 {
-    lock->Acquire();			// only one disk I/O at a time
-    disk->ReadRequest(sectorNumber, data);
-    semaphore->P();			// wait for interrupt
+    CacheEntry *entry;
+    bool hit;
+
+    lock->Acquire();
+    Reap();
+    entry = Find(sectorNumber, &hit);
+    if (hit) {
+	kernel->stats->numCacheHits++;
+	Consume(entry, TRUE);
+    } else {
+	kernel->stats->numCacheMisses++;
+	Fill(entry);
+    }
+    Touch(entry);
+    bcopy(entry->data, data, SectorSize);
     lock->Release();
 }
 
 //----------------------------------------------------------------------
 // SynchDisk::WriteSector
-// 	Write the contents of a buffer into a disk sector.  Return only
-//	after the data has been written.
+// 	Write the contents of a buffer into a disk sector.  The new
+//	contents are kept in the cache, and only reach the disk when the
+//	entry is evicted or the cache is synced.  Since a whole sector
+//	is overwritten, a miss does not need to read the old contents.
+//
+//	Inside a transaction, the sector is also logged and pinned --
+//	unless the write changes nothing, which is common when a whole
+//	directory is written back for the sake of one entry.
 //
 //	"sectorNumber" -- the disk sector to be written
 //	"data" -- the new contents of the disk sector
@@ -75,20 +180,1194 @@ SynchDisk::ReadSector(int sectorNumber, char* data)
 void
 SynchDisk::WriteSector(int sectorNumber, char* data)
 {
-    lock->Acquire();			// only one disk I/O at a time
-    disk->WriteRequest(sectorNumber, data);
-    semaphore->P();			// wait for interrupt
+    CacheEntry *entry;
+    bool hit, journaled;
+
+    lock->Acquire();
+    Reap();
+    entry = Find(sectorNumber, &hit);
+    if (hit)
+	kernel->stats->numCacheHits++;
+    else
+	kernel->stats->numCacheMisses++;
+    journaled = (journal != NULL && journal->InTransaction());
+    if (!(journaled && hit && memcmp(data, entry->data, SectorSize) == 0)) {
+	Consume(entry, FALSE);
+	bcopy(data, entry->data, SectorSize);
+	entry->dirty = TRUE;
+	if (journaled && !entry->pinned) {
+	    journal->Log(sectorNumber);
+	    entry->pinned = TRUE;
+	}
+    }
+    Touch(entry);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::ReadSectors
+// 	Read "numSectors" consecutive disk sectors into a buffer.  Sectors
+//	already in the cache are copied out of it; each run of uncached
+//	sectors is fetched with a single multi-sector disk request.
+//	Short transfers are entered into the cache like ReadSector, as
+//	long as there are clean entries to put them in; long ones (more
+//	than CacheBypassSectors) are not, so that a sequential scan of a
+//	big file does not push everything else out.
+//
+//	"sectorNumber" -- the first disk sector to read
+//	"numSectors" -- how many sectors to read
+//	"data" -- the buffer to hold the contents of the disk sectors
+//----------------------------------------------------------------------
+
+void
+SynchDisk::ReadSectors(int sectorNumber, int numSectors, char* data)
+{
+    CacheEntry **run = new CacheEntry *[numSectors];
+    CacheEntry *entry;
+    bool hit;
+    int i, j, count;
+
+    lock->Acquire();
+    Reap();
+    for (i = 0; i < numSectors; i += count) {
+	if (numSectors > CacheBypassSectors) {
+	    entry = Lookup(sectorNumber + i);
+	    if (entry != NULL && entry->busy) {
+		WaitIdle(entry);	// try this sector again
+		count = 0;
+		continue;
+	    }
+	    hit = (entry != NULL);
+	} else {
+	    entry = Find(sectorNumber + i, &hit);
+	}
+	if (hit) {
+	    kernel->stats->numCacheHits++;
+	    Consume(entry, TRUE);
+	    Touch(entry);
+	    bcopy(entry->data, data + i * SectorSize, SectorSize);
+	    count = 1;
+	    continue;
+	}
+
+	// a miss: extend it over the following uncached sectors
+	if (entry != NULL) {
+	    run[0] = entry;
+	    entry->busy = TRUE;
+	}
+	for (count = 1; i + count < numSectors; count++) {
+	    if (Lookup(sectorNumber + i + count) != NULL)
+		break;
+	    if (entry != NULL) {	// cached read: needs a clean entry
+		run[count] = Victim();
+		if (run[count] == NULL || run[count]->dirty)
+		    break;
+		Reassign(run[count], sectorNumber + i + count);
+		run[count]->busy = TRUE;
+	    }
+	}
+	kernel->stats->numCacheMisses += count;
+	if (entry == NULL) {		// straight to the caller's buffer
+	    DiskRequest *request = Issue(sectorNumber + i,
+				data + i * SectorSize, count, FALSE);
+	    lock->Release();
+	    Wait(request);
+	    lock->Acquire();
+	    continue;
+	}
+	lock->Release();
+	DiskRead(sectorNumber + i, data + i * SectorSize, count);
+	lock->Acquire();
+	for (j = 0; j < count; j++) {
+	    bcopy(data + (i + j) * SectorSize, run[j]->data, SectorSize);
+	    run[j]->busy = FALSE;
+	    Touch(run[j]);
+	}
+	ioDone->Broadcast(lock);
+    }
+    lock->Release();
+    delete [] run;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::WriteSectors
+// 	Write a buffer into "numSectors" consecutive disk sectors.  Short
+//	transfers, and any made inside a transaction, are absorbed by the
+//	cache, exactly as WriteSector would.
+//	Long ones are sent to the disk as one request; any of the sectors
+//	that happen to be cached are updated in place, and are now clean.
+//
+//	"sectorNumber" -- the first disk sector to be written
+//	"numSectors" -- how many sectors to write
+//	"data" -- the new contents of the disk sectors
+//----------------------------------------------------------------------
+
+void
+SynchDisk::WriteSectors(int sectorNumber, int numSectors, char* data)
+{
+    CacheEntry *entry;
+    DiskRequest *request;
+    int i;
+
+    if (numSectors <= CacheBypassSectors 
+		|| (journal != NULL && journal->InTransaction())) {
+	for (i = 0; i < numSectors; i++)
+	    WriteSector(sectorNumber + i, data + i * SectorSize);
+	return;
+    }
+
+    lock->Acquire();
+    Reap();
+    for (i = 0; i < numSectors; i++) {
+	entry = Lookup(sectorNumber + i);
+	if (entry != NULL && entry->busy) {
+	    WaitIdle(entry);		// try this sector again
+	    i--;
+	} else if (entry != NULL) {
+	    Consume(entry, FALSE);
+	    bcopy(data + i * SectorSize, entry->data, SectorSize);
+	    entry->dirty = FALSE;
+	}
+    }
+    // queue the write before letting go of the cache; a later request
+    // for any of the same sectors is queued behind it, and NextRequest
+    // never lets it overtake
+    request = Issue(sectorNumber, data, numSectors, TRUE);
+    lock->Release();
+    Wait(request);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Sync
+// 	Write every dirty sector in the cache back to the disk.  All the
+//	write-backs are queued at once, so the scheduling policy can
+//	order them; for FCFS they are issued in increasing sector order
+//	so that the head sweeps across the disk once.  The entries stay
+//	cached (and become clean).  Pinned entries are left alone until
+//	their transaction has committed.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Sync()
+{
+    CacheEntry **dirty = new CacheEntry *[NumCacheEntries];
+    DiskRequest **requests = new DiskRequest *[NumCacheEntries];
+    int numDirty;
+    int i, j;
+
+    lock->Acquire();
+    for (;;) {
+	numDirty = 0;
+	for (i = 0; i < NumCacheEntries; i++) {
+	    if (cache[i].busy)
+		break;
+	    if (cache[i].sector == -1 || !cache[i].dirty || cache[i].pinned)
+		continue;
+	    for (j = numDirty; j > 0 && dirty[j - 1]->sector > cache[i].sector; j--)
+		dirty[j] = dirty[j - 1];	// insertion sort by sector number
+	    dirty[j] = &cache[i];
+	    numDirty++;
+	}
+	if (i == NumCacheEntries)
+	    break;
+	WaitIdle(&cache[i]);		// let outstanding I/O finish first
+    }
+    for (i = 0; i < numDirty; i++) {
+	dirty[i]->busy = TRUE;
+	requests[i] = Issue(dirty[i]->sector, dirty[i]->data, 1, TRUE);
+    }
+    lock->Release();
+    for (i = 0; i < numDirty; i++)
+	Wait(requests[i]);
+    lock->Acquire();
+    for (i = 0; i < numDirty; i++) {
+	dirty[i]->dirty = FALSE;
+	dirty[i]->busy = FALSE;
+    }
+    ioDone->Broadcast(lock);
     lock->Release();
+    delete [] requests;
+    delete [] dirty;
 }
 
 //----------------------------------------------------------------------
 // SynchDisk::CallBack
-// 	Disk interrupt handler.  Wake up any thread waiting for the disk
-//	request to finish.
+// 	Disk interrupt handler.  Note how long the finished request took,
+//	from being queued to now, start the next queued request if there
+//	is one, and wake up the thread waiting for the finished request.
 //----------------------------------------------------------------------
 
 void
 SynchDisk::CallBack()
-{ 
-    semaphore->V();
+{
+    DiskRequest *finished = active;
+
+    ASSERT(finished != NULL);
+    if (numLatency == maxLatency) {	// grow the sample array
+	int *bigger = new int[maxLatency * 2];
+
+	bcopy((char *) latency, (char *) bigger, maxLatency * sizeof(int));
+	delete [] latency;
+	latency = bigger;
+	maxLatency *= 2;
+    }
+    latency[numLatency++] = kernel->stats->totalTicks - finished->issued;
+    finished->completed = TRUE;
+
+    active = NULL;
+    if (!queue->IsEmpty())
+	Start(NextRequest());
+    finished->done->V();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::PrintStats
+// 	Print the mean and 99th percentile time requests spent between
+//	being issued and completing, under the current policy.
+//----------------------------------------------------------------------
+
+static int
+CompareInt(const void *x, const void *y)
+{
+    return *(const int *) x - *(const int *) y;
+}
+
+void
+SynchDisk::PrintStats()
+{
+    static const char *policyName[] = { "FCFS", "SSTF", "SCAN", "C-LOOK" };
+    double total = 0;
+    int i;
+
+    cout << "Disk queue (" << policyName[policy] << "): requests " << numLatency;
+    if (numLatency > 0) {
+	qsort(latency, numLatency, sizeof(int), CompareInt);
+	for (i = 0; i < numLatency; i++)
+	    total += latency[i];
+	cout << ", mean latency " << (int) (total / numLatency);
+	cout << ", p99 latency " << latency[(numLatency * 99 + 99) / 100 - 1];
+    }
+    cout << "\n";
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Lookup
+// 	Return the cache entry holding "sectorNumber", or NULL if the
+//	sector is not cached.
+//----------------------------------------------------------------------
+
+CacheEntry *
+SynchDisk::Lookup(int sectorNumber)
+{
+    CacheEntry *entry = buckets[sectorNumber % NumCacheBuckets];
+
+    while (entry != NULL && entry->sector != sectorNumber)
+	entry = entry->hashNext;
+    return entry;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Find
+// 	Return the cache entry for "sectorNumber", once no I/O is in
+//	progress on it.  If the sector is not cached, the least recently
+//	used idle entry is reassigned to it (writing it back first if it
+//	is dirty), "*hit" is set to FALSE, and the caller must fill in the
+//	data.  The lock is held on entry and on return, but may be given
+//	up in between.
+//----------------------------------------------------------------------
+
+CacheEntry *
+SynchDisk::Find(int sectorNumber, bool *hit)
+{
+    CacheEntry *entry;
+
+    for (;;) {
+	entry = Lookup(sectorNumber);
+	if (entry != NULL) {
+	    if (!entry->busy) {
+		*hit = TRUE;
+		return entry;
+	    }
+	    WaitIdle(entry);
+	    continue;
+	} else {
+	    entry = Victim();
+	    if (entry != NULL && !entry->dirty) {
+		Reassign(entry, sectorNumber);
+		*hit = FALSE;
+		return entry;
+	    }
+	    if (entry != NULL) {
+		WriteBack(entry);
+		continue;		// things may have changed meanwhile
+	    }
+	}
+	if (!prefetches->IsEmpty())	// no entry is idle
+	    Complete(prefetches->Front());
+	else
+	    ioDone->Wait(lock);
+    }
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Victim
+// 	Return the least recently used cache entry that has no I/O in
+//	progress and is not pinned, or NULL if there is none.
+//----------------------------------------------------------------------
+
+CacheEntry *
+SynchDisk::Victim()
+{
+    CacheEntry *entry = lruTail;
+
+    while (entry != NULL && (entry->busy || entry->pinned))
+	entry = entry->lruPrev;
+    return entry;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Reassign
+// 	Give a clean, idle cache entry to "sectorNumber".  The caller
+//	fills in the data.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Reassign(CacheEntry *entry, int sectorNumber)
+{
+    int bucket = sectorNumber % NumCacheBuckets;
+
+    ASSERT(!entry->busy && !entry->dirty && !entry->pinned);
+    Consume(entry, FALSE);
+    if (entry->sector != -1) {
+	kernel->stats->numCacheEvictions++;
+	Unhash(entry);
+    }
+    entry->sector = sectorNumber;
+    entry->hashNext = buckets[bucket];
+    buckets[bucket] = entry;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Fill/WriteBack
+// 	Read a cache entry's sector in from the disk, or write it out.
+//	The entry is busy while the request is outstanding, and the lock
+//	is released so other threads can use the rest of the cache.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Fill(CacheEntry *entry)
+{
+    entry->busy = TRUE;
+    lock->Release();
+    DiskRead(entry->sector, entry->data);
+    lock->Acquire();
+    entry->busy = FALSE;
+    ioDone->Broadcast(lock);
+}
+
+void
+SynchDisk::WriteBack(CacheEntry *entry)
+{
+    DiskRequest *request;
+
+    DEBUG(dbgDisk, "Cache writing back sector " << entry->sector);
+    entry->busy = TRUE;
+    request = Issue(entry->sector, entry->data, 1, TRUE);
+    lock->Release();
+    Wait(request);
+    lock->Acquire();
+    entry->dirty = FALSE;
+    entry->busy = FALSE;
+    ioDone->Broadcast(lock);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::ReadAhead
+// 	Start reading "numSectors" consecutive sectors into the cache,
+//	and return without waiting for the disk.  Sectors already cached
+//	are skipped; each run of the others is read with one request.
+//	Read-ahead is only a guess, so it is not worth writing anything
+//	back for: it stops at the first sector that would need a dirty
+//	(or busy) entry.
+//
+//	"sectorNumber" -- the first disk sector to read
+//	"numSectors" -- how many sectors to read
+//----------------------------------------------------------------------
+
+void
+SynchDisk::ReadAhead(int sectorNumber, int numSectors)
+{
+    Prefetch *prefetch;
+    CacheEntry *entry;
+    int i, count;
+
+    lock->Acquire();
+    Reap();
+    for (i = 0; i < numSectors; i += count) {
+	if (Lookup(sectorNumber + i) != NULL) {
+	    count = 1;			// cached, or on its way
+	    continue;
+	}
+	prefetch = new Prefetch;
+	prefetch->entries = new CacheEntry *[numSectors - i];
+	for (count = 0; i + count < numSectors; count++) {
+	    if (count > 0 && Lookup(sectorNumber + i + count) != NULL)
+		break;
+	    entry = Victim();
+	    if (entry == NULL || entry->dirty)
+		break;
+	    Reassign(entry, sectorNumber + i + count);
+	    entry->busy = TRUE;
+	    entry->prefetch = prefetch;
+	    Touch(entry);
+	    prefetch->entries[count] = entry;
+	}
+	if (count == 0) {		// no clean entry to read into
+	    delete [] prefetch->entries;
+	    delete prefetch;
+	    break;
+	}
+	DEBUG(dbgDisk, "Reading ahead " << count << " sectors at " << sectorNumber + i);
+	kernel->stats->numPrefetched += count;
+	prefetch->numSectors = count;
+	prefetch->buffer = new char[count * SectorSize];
+	prefetch->request = Issue(sectorNumber + i, prefetch->buffer, count, 
+				FALSE);
+	prefetches->Append(prefetch);
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::WaitIdle
+// 	Wait until a busy cache entry is idle again.  If it is busy
+//	because of a read-ahead that no one has waited for yet, we wait
+//	for the disk ourselves and fill in the cache; otherwise someone
+//	else will, and broadcast ioDone when done.  The lock is held on
+//	entry and on return, but not in between.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::WaitIdle(CacheEntry *entry)
+{
+    ASSERT(entry->busy);
+    if (entry->prefetch != NULL)
+	Complete(entry->prefetch);
+    else
+	ioDone->Wait(lock);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Complete
+// 	Wait for a read-ahead to finish, if it has not already, and copy
+//	the sectors into their cache entries.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Complete(Prefetch *prefetch)
+{
+    int i;
+
+    prefetches->Remove(prefetch);	// no one else will complete it
+    for (i = 0; i < prefetch->numSectors; i++)
+	prefetch->entries[i]->prefetch = NULL;
+    lock->Release();
+    Wait(prefetch->request);
+    lock->Acquire();
+    for (i = 0; i < prefetch->numSectors; i++) {
+	bcopy(prefetch->buffer + i * SectorSize, prefetch->entries[i]->data,
+				SectorSize);
+	prefetch->entries[i]->busy = FALSE;
+	prefetch->entries[i]->prefetched = TRUE;
+    }
+    ioDone->Broadcast(lock);
+    delete [] prefetch->buffer;
+    delete [] prefetch->entries;
+    delete prefetch;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Reap
+// 	Move the data of every read-ahead the disk has finished into the
+//	cache, so the entries become usable (and evictable).  None of
+//	them has to wait.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Reap()
+{
+    Prefetch *prefetch;
+    bool found;
+
+    do {
+	ListIterator<Prefetch *> iter(prefetches);
+
+	found = FALSE;
+	for (; !iter.IsDone(); iter.Next()) {
+	    if (iter.Item()->request->completed) {
+		prefetch = iter.Item();
+		found = TRUE;
+		break;
+	    }
+	}
+	if (found)
+	    Complete(prefetch);		// changes the list
+    } while (found);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Consume
+// 	A cache entry is about to be read ("used" is TRUE), overwritten
+//	or evicted.  If it holds a sector read ahead that no one has
+//	read yet, count the read-ahead as a hit or as wasted.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Consume(CacheEntry *entry, bool used)
+{
+    if (!entry->prefetched)
+	return;
+    entry->prefetched = FALSE;
+    if (used)
+	kernel->stats->numPrefetchHits++;
+    else
+	kernel->stats->numPrefetchWasted++;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Touch
+// 	Move a cache entry to the front of the LRU list.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Touch(CacheEntry *entry)
+{
+    if (entry == lruHead)
+	return;
+
+    // unlink
+    entry->lruPrev->lruNext = entry->lruNext;
+    if (entry->lruNext != NULL)
+	entry->lruNext->lruPrev = entry->lruPrev;
+    else
+	lruTail = entry->lruPrev;
+
+    // relink at the front
+    entry->lruPrev = NULL;
+    entry->lruNext = lruHead;
+    lruHead->lruPrev = entry;
+    lruHead = entry;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Unhash
+// 	Remove a cache entry from the hash chain of its current sector.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Unhash(CacheEntry *entry)
+{
+    CacheEntry **ptr = &buckets[entry->sector % NumCacheBuckets];
+
+    while (*ptr != entry) {
+	ASSERT(*ptr != NULL);		// entry must be on its chain
+	ptr = &(*ptr)->hashNext;
+    }
+    *ptr = entry->hashNext;
+    entry->hashNext = NULL;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Issue
+// 	Queue a request for the raw disk, starting it right away if the
+//	disk is idle, and return it without waiting.  The caller must
+//	eventually Wait for it.
+//
+//	"sectorNumber" -- the first disk sector to read/write
+//	"data" -- the buffer to hold or supply the sector contents
+//	"numSectors" -- the number of consecutive sectors to transfer
+//	"writing" -- is this a write?
+//----------------------------------------------------------------------
+
+DiskRequest *
+SynchDisk::Issue(int sectorNumber, char *data, int numSectors, bool writing)
+{
+    DiskRequest *request = new DiskRequest(sectorNumber, data, numSectors,
+					writing);
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+
+    request->issued = kernel->stats->totalTicks;
+    if (active == NULL)
+	Start(request);
+    else
+	queue->Append(request);
+    (void) kernel->interrupt->SetLevel(oldLevel);
+    return request;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Wait
+// 	Wait for a request returned by Issue to complete, and free it.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Wait(DiskRequest *request)
+{
+    request->done->P();			// wait for interrupt
+    delete request;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::DiskRead/DiskWrite
+// 	Send a single request to the raw disk, and wait for the
+//	interrupt that signals it is done.
+//
+//	"sectorNumber" -- the first disk sector to read/write
+//	"data" -- the buffer to hold or supply the sector contents
+//	"numSectors" -- the number of consecutive sectors to transfer
+//----------------------------------------------------------------------
+
+void
+SynchDisk::DiskRead(int sectorNumber, char *data, int numSectors)
+{
+    Wait(Issue(sectorNumber, data, numSectors, FALSE));
+}
+
+void
+SynchDisk::DiskWrite(int sectorNumber, char *data, int numSectors)
+{
+    Wait(Issue(sectorNumber, data, numSectors, TRUE));
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Start
+// 	Hand a request to the raw disk.  Interrupts are off.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Start(DiskRequest *request)
+{
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+    ASSERT(active == NULL);
+
+    active = request;
+    if (request->writing)
+	disk->WriteRequest(request->sector, request->data, request->numSectors);
+    else
+	disk->ReadRequest(request->sector, request->data, request->numSectors);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::NextRequest
+// 	Remove and return the queued request to serve next.  Distances
+//	are measured in tracks from where the disk head is now, which is
+//	what Disk::TimeToSeek charges for; among requests on the same
+//	track, the oldest goes first.  A request that overlaps an older
+//	one still queued, where either of them is a write, must wait for
+//	it (see Overtakes), whatever the policy.  Interrupts are off.
+//
+//	FCFS -- the oldest request
+//	SSTF -- the request closest to the head
+//	SCAN -- the closest request in the direction the head is moving;
+//		if there is none, the head turns around
+//	C-LOOK -- the closest request at or above the head; if there is
+//		none, the one on the lowest track
+//----------------------------------------------------------------------
+
+DiskRequest *
+SynchDisk::NextRequest()
+{
+    ListIterator<DiskRequest *> iter(queue);
+    int head = disk->HeadTrack();
+    DiskRequest *best = NULL;
+    DiskRequest *lowest = NULL;
+    DiskRequest *request;
+    int distance, bestDistance = 0;
+
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+    if (policy == DiskFCFS)
+	return queue->RemoveFront();
+
+    for (; !iter.IsDone(); iter.Next()) {
+	request = iter.Item();
+	if (Overtakes(request))
+	    continue;
+	distance = request->track - head;
+	if (lowest == NULL || request->track < lowest->track)
+	    lowest = request;
+	switch (policy) {
+	  case DiskSSTF:
+	    distance = abs(distance);
+	    break;
+	  case DiskSCAN:
+	  case DiskCLOOK:
+	    if (!sweepUp)
+		distance = -distance;
+	    if (distance < 0)		// behind the head
+		continue;
+	    break;
+	  default:
+	    ASSERT(FALSE);
+	}
+	if (best == NULL || distance < bestDistance) {
+	    best = request;
+	    bestDistance = distance;
+	}
+    }
+
+    if (best == NULL) {			// nothing ahead of the head
+	if (policy == DiskCLOOK) {
+	    best = lowest;
+	} else {
+	    sweepUp = !sweepUp;
+	    return NextRequest();
+	}
+    }
+    queue->Remove(best);
+    return best;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Overtakes
+// 	Return TRUE if serving "request" now would overtake an older
+//	queued request for any of the same sectors, one of the two being
+//	a write -- say a write-back issued after a cache-bypassing write
+//	of the same sector, or a read of a sector with a write pending.
+//	The one at the front of the queue never does.  Interrupts are off.
+//----------------------------------------------------------------------
+
+bool
+SynchDisk::Overtakes(DiskRequest *request)
+{
+    ListIterator<DiskRequest *> iter(queue);
+    DiskRequest *older;
+
+    for (; iter.Item() != request; iter.Next()) {
+	older = iter.Item();
+	if ((older->writing || request->writing)
+		&& older->sector < request->sector + request->numSectors
+		&& request->sector < older->sector + older->numSectors)
+	    return TRUE;
+    }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// Journal::Journal
+// 	Set up a journal kept in "numSectors" sectors of the disk,
+//	starting with "firstSector".  Format or Recover must be called
+//	before the first transaction.
+//----------------------------------------------------------------------
+
+Journal::Journal(int firstSector, int numSectors)
+{
+    static char lockName[] = "journal lock";
+    static char changedName[] = "journal changed";
+
+    start = firstSector;
+    size = numSectors;
+    ASSERT(size > RecordLength(MaxGroupBlocks));
+    head = start + 1;
+    sequence = 1;
+
+    lock = new Lock(lockName);
+    changed = new Condition(changedName);
+    outstanding = 0;
+    committing = FALSE;
+    members = new List<Transaction *>;
+    opened = committed = 0;
+
+    group = new int[MaxGroupBlocks];
+    groupSize = 0;
+}
+
+//----------------------------------------------------------------------
+// Journal::~Journal
+// 	De-allocate the journal.  No transaction may be in progress.
+//----------------------------------------------------------------------
+
+Journal::~Journal()
+{
+    ASSERT(outstanding == 0 && groupSize == 0);
+    delete [] group;
+    delete members;
+    delete changed;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// Journal::RecordLength
+// 	Return the number of log sectors taken by a record of "count"
+//	blocks: the descriptors, the blocks, and the commit sector.
+//----------------------------------------------------------------------
+
+int
+Journal::RecordLength(int count)
+{
+    int perSector = SectorSize / sizeof(int);
+
+    return divRoundUp(3 + count, perSector) + count + 1;
+}
+
+//----------------------------------------------------------------------
+// Journal::WriteStart
+// 	Record on disk that the log is empty, and that its first record
+//	will carry the current sequence number.  Records left over from
+//	before carry older numbers, so Recover will not take them.
+//----------------------------------------------------------------------
+
+void
+Journal::WriteStart()
+{
+    int buf[SectorSize / sizeof(int)];
+
+    bzero((char *) buf, SectorSize);
+    buf[0] = LogMagic;
+    buf[1] = sequence;
+    head = start + 1;
+    kernel->synchDisk->DiskWrite(start, (char *) buf);
+}
+
+//----------------------------------------------------------------------
+// Journal::Format
+// 	Start an empty log on a freshly formatted disk.  The sector after
+//	the first is cleared as well, in case the disk held a log before.
+//----------------------------------------------------------------------
+
+void
+Journal::Format()
+{
+    char buf[SectorSize];
+
+    DEBUG(dbgFile, "Formatting the journal at sector " << start);
+    bzero(buf, SectorSize);
+    kernel->synchDisk->DiskWrite(start + 1, buf);
+    sequence = 1;
+    WriteStart();
+}
+
+//----------------------------------------------------------------------
+// Journal::Recover
+// 	Reinstall, in order, every complete record in the log, starting
+//	from the sequence number in the first sector of the log region.
+//	A record is complete if its descriptor and its commit sector
+//	both carry the expected sequence number; the first one that is
+//	not ends the log.  The blocks are written straight to their home
+//	sectors (nothing is cached yet at mount time), and then the log
+//	is emptied.
+//----------------------------------------------------------------------
+
+void
+Journal::Recover()
+{
+    int perSector = SectorSize / sizeof(int);
+    int buf[SectorSize / sizeof(int)];
+    int *record, *commit;
+    int count, numDesc, length, i;
+
+    kernel->synchDisk->DiskRead(start, (char *) buf);
+    if (buf[0] != LogMagic) {
+	DEBUG(dbgFile, "No journal found, starting an empty one");
+	Format();
+	return;
+    }
+    sequence = buf[1];
+    for (head = start + 1; head < start + size; head += length) {
+	kernel->synchDisk->DiskRead(head, (char *) buf);
+	count = buf[2];
+	if (buf[0] != LogMagic || buf[1] != sequence 
+		|| count <= 0 || count > MaxGroupBlocks)
+	    break;			// end of the log
+	length = RecordLength(count);
+	if (head + length > start + size)
+	    break;
+	numDesc = divRoundUp(3 + count, perSector);
+
+	record = new int[length * perSector];
+	kernel->synchDisk->DiskRead(head, (char *) record, length);
+	commit = record + (numDesc + count) * perSector;
+	if (commit[0] != LogCommitMagic || commit[1] != sequence 
+		|| commit[2] != count) {
+	    delete [] record;		// torn: never committed
+	    break;
+	}
+	DEBUG(dbgFile, "Replaying journal record " << sequence << ", " << count << " blocks");
+	for (i = 0; i < count; i++)
+	    kernel->synchDisk->DiskWrite(record[3 + i],
+			(char *) (record + (numDesc + i) * perSector));
+	kernel->stats->numJournalReplayed += count;
+	delete [] record;
+	sequence++;
+    }
+    WriteStart();
+}
+
+//----------------------------------------------------------------------
+// Journal::Find
+// 	Return the transaction "thread" is in, or NULL.  Called with the
+//	journal lock held.
+//----------------------------------------------------------------------
+
+Transaction *
+Journal::Find(Thread *thread)
+{
+    ListIterator<Transaction *> iter(members);
+
+    for (; !iter.IsDone(); iter.Next())
+	if (iter.Item()->thread == thread)
+	    return iter.Item();
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// Journal::InTransaction
+// 	Return TRUE if the current thread is between Begin and End.
+//----------------------------------------------------------------------
+
+bool
+Journal::InTransaction()
+{
+    bool member;
+
+    lock->Acquire();
+    member = (Find(kernel->currentThread) != NULL);
+    lock->Release();
+    return member;
+}
+
+//----------------------------------------------------------------------
+// Journal::Logged
+// 	Return how many sectors the current thread's transaction has
+//	logged so far (0 if it is in none), so that an operation can
+//	tell whether more work still fits in MaxTransactionBlocks.
+//----------------------------------------------------------------------
+
+int
+Journal::Logged()
+{
+    Transaction *transaction;
+    int logged;
+
+    lock->Acquire();
+    transaction = Find(kernel->currentThread);
+    logged = (transaction == NULL) ? 0 : transaction->logged;
+    lock->Release();
+    return logged;
+}
+
+//----------------------------------------------------------------------
+// Journal::Ticket/WaitCommitted
+// 	Ticket returns a ticket for every change logged so far, by any
+//	transaction, including those still in progress; WaitCommitted
+//	returns once all the changes a ticket stands for are committed,
+//	and so will survive a crash.  The ticket is simply the number of
+//	the latest group.  The caller must not be in a transaction.
+//----------------------------------------------------------------------
+
+int
+Journal::Ticket()
+{
+    int ticket;
+
+    lock->Acquire();
+    ticket = opened;
+    lock->Release();
+    return ticket;
+}
+
+void
+Journal::WaitCommitted(int ticket)
+{
+    lock->Acquire();
+    ASSERT(Find(kernel->currentThread) == NULL);
+    while (committed < ticket)
+	changed->Wait(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::Begin
+// 	Start a transaction for the current thread.  A nested Begin just
+//	stays in the transaction already open.  Otherwise wait while a
+//	commit is being written, or while the current group has no room
+//	left for one more transaction of MaxTransactionBlocks sectors.
+//	If the log itself has no room for a full group, checkpoint first.
+//----------------------------------------------------------------------
+
+void
+Journal::Begin()
+{
+    Thread *thread = kernel->currentThread;
+    Transaction *transaction;
+
+    lock->Acquire();
+    transaction = Find(thread);
+    if (transaction != NULL) {
+	transaction->depth++;		// nested
+	lock->Release();
+	return;
+    }
+    for (;;) {
+	if (committing || (outstanding > 0 && groupSize 
+		+ (outstanding + 1) * MaxTransactionBlocks > MaxGroupBlocks)) {
+	    changed->Wait(lock);
+	} else if (outstanding == 0 
+		&& start + size - head < RecordLength(MaxGroupBlocks)) {
+	    committing = TRUE;
+	    lock->Release();
+	    Checkpoint();
+	    lock->Acquire();
+	    committing = FALSE;
+	    changed->Broadcast(lock);
+	} else {
+	    break;
+	}
+    }
+    if (outstanding == 0)
+	opened++;			// the first of a new group
+    outstanding++;
+    transaction = new Transaction;
+    transaction->thread = thread;
+    transaction->depth = 1;
+    transaction->logged = 0;
+    members->Append(transaction);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::End
+// 	Finish the current thread's transaction.  The last transaction of
+//	a group to end commits the whole group.
+//----------------------------------------------------------------------
+
+void
+Journal::End()
+{
+    Transaction *transaction;
+
+    lock->Acquire();
+    transaction = Find(kernel->currentThread);
+    ASSERT(transaction != NULL);
+    if (--transaction->depth > 0) {
+	lock->Release();		// nested
+	return;
+    }
+    members->Remove(transaction);
+    delete transaction;
+    if (--outstanding > 0) {
+	lock->Release();		// others still running
+	return;
+    }
+    committing = TRUE;
+    lock->Release();
+
+    Commit();
+
+    lock->Acquire();
+    committed++;
+    committing = FALSE;
+    changed->Broadcast(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::Log
+// 	Add "sectorNumber" to the group being built, on behalf of the
+//	current thread's transaction; the caller pins it.  A transaction
+//	must stay within MaxTransactionBlocks sectors: Begin only lets it
+//	into a group with that much room left, so there is then always
+//	room for the sector.  Nothing may bypass the log once a
+//	transaction has started, or a crash could tear it.
+//----------------------------------------------------------------------
+
+void
+Journal::Log(int sectorNumber)
+{
+    Transaction *transaction;
+
+    lock->Acquire();
+    transaction = Find(kernel->currentThread);
+    ASSERT(transaction != NULL);
+    transaction->logged++;
+    ASSERT(transaction->logged <= MaxTransactionBlocks);
+    ASSERT(groupSize < MaxGroupBlocks);
+    group[groupSize++] = sectorNumber;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::Commit
+// 	Write the current group to the log as one record, with a single
+//	disk request, then unpin its sectors so the cache may write them
+//	home whenever it likes.
+//----------------------------------------------------------------------
+
+void
+Journal::Commit()
+{
+    SynchDisk *disk = kernel->synchDisk;
+    int perSector = SectorSize / sizeof(int);
+    int count, numDesc, length, i;
+    CacheEntry *entry;
+    int *record, *commit;
+
+    disk->lock->Acquire();
+    count = groupSize;
+    if (count == 0) {			// nothing was changed
+	disk->lock->Release();
+	return;
+    }
+    numDesc = divRoundUp(3 + count, perSector);
+    length = RecordLength(count);
+    ASSERT(head + length <= start + size);
+
+    record = new int[length * perSector];
+    bzero((char *) record, length * SectorSize);
+    record[0] = LogMagic;
+    record[1] = sequence;
+    record[2] = count;
+    for (i = 0; i < count; i++) {
+	entry = disk->Lookup(group[i]);
+	ASSERT(entry != NULL && entry->pinned);
+	record[3 + i] = group[i];
+	bcopy(entry->data, (char *) (record + (numDesc + i) * perSector),
+				SectorSize);
+    }
+    commit = record + (numDesc + count) * perSector;
+    commit[0] = LogCommitMagic;
+    commit[1] = sequence;
+    commit[2] = count;
+    disk->lock->Release();
+
+    DEBUG(dbgFile, "Committing journal record " << sequence << ", " << count << " blocks");
+    disk->DiskWrite(head, (char *) record, length);
+    head += length;
+    sequence++;
+    kernel->stats->numJournalCommits++;
+    kernel->stats->numJournalBlocks += count;
+    delete [] record;
+
+    disk->lock->Acquire();
+    for (i = 0; i < count; i++)
+	disk->Lookup(group[i])->pinned = FALSE;
+    groupSize = 0;
+    disk->ioDone->Broadcast(disk->lock);	// more entries can be evicted
+    disk->lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::Checkpoint
+// 	Empty the log: write every dirty sector in the cache home, which
+//	includes every block the committed records hold, then start the
+//	log over.
+//----------------------------------------------------------------------
+
+void
+Journal::Checkpoint()
+{
+    ASSERT(groupSize == 0);
+    DEBUG(dbgFile, "Journal checkpoint before record " << sequence);
+    kernel->synchDisk->Sync();
+    kernel->stats->numJournalCheckpoints++;
+    WriteStart();
 }
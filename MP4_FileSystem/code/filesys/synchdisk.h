@@ -15,6 +15,79 @@
 #include "synch.h"
 #include "callback.h"
 
+// Size of the sector buffer cache kept in front of the disk.  Sectors
+// are located through a hash table of "NumCacheBuckets" chains, and
+// replaced in least-recently-used order.
+
+const int NumCacheEntries = 256;	// # of sectors held in the cache
+const int NumCacheBuckets = 61;		// # of hash chains (prime)
+const int CacheBypassSectors = 32;	// longer multi-sector transfers go
+					// straight to the disk, so a large
+					// file copy does not flush the cache
+
+// The following class defines one request waiting for, or being
+// served by, the raw disk.  The thread that issued it waits on "done".
+
+class DiskRequest {
+  public:
+    DiskRequest(int sectorNumber, char *buffer, int count, bool isWrite);
+    ~DiskRequest();
+
+    int sector;				// first sector to transfer
+    int numSectors;			// number of consecutive sectors
+    char *data;				// where the data comes from/goes to
+    bool writing;			// write request?
+    int track;				// track of the first sector
+    int issued;				// time at which it was queued
+    bool completed;			// has the disk finished it?
+    Semaphore *done;			// signalled when the request completes
+};
+
+class CacheEntry;
+
+// The following class defines a read-ahead in progress: a run of
+// sectors read into a buffer of their own with one disk request, and
+// the (busy) cache entries they go into once it completes.  Nobody
+// waits for the request when it is issued; the first thread that needs
+// one of the entries, or finds the request completed, copies the data
+// into the cache.
+
+class Prefetch {
+  public:
+    DiskRequest *request;		// the disk request reading the run
+    CacheEntry **entries;		// where each sector goes
+    int numSectors;			// length of the run
+    char *buffer;			// what the disk reads into
+};
+
+// The following class defines one buffer of the sector cache.
+// An entry is either free (sector == -1) or holds the current contents
+// of one disk sector; "dirty" entries have been modified since they 
+// were last read from or written to the disk.  While an entry is
+// "busy", a disk request is filling it in or writing it back; other
+// threads must wait for that to finish before using it.  An entry
+// brought in by read-ahead is "prefetched" until it is first read.
+// A "pinned" entry holds a change made by a transaction that has not
+// been committed to the journal yet; it must not reach its home
+// sector before then, so it is never evicted or synced.
+//
+// Internal data structures kept public so that SynchDisk can
+// access them directly.
+
+class CacheEntry {
+  public:
+    int sector;				// disk sector held, -1 if free
+    bool dirty;				// must be written back before reuse?
+    bool busy;				// disk I/O in progress?
+    Prefetch *prefetch;			// read-ahead filling it, if any
+    bool prefetched;			// read ahead, and not yet used?
+    bool pinned;			// uncommitted journaled change?
+    CacheEntry *hashNext;		// next entry in the same hash chain
+    CacheEntry *lruPrev;		// neighbours in the LRU chain;
+    CacheEntry *lruNext;		//  most recently used at the front
+    char data[SectorSize];		// contents of the sector
+};
+
 // The following class defines a "synchronous" disk abstraction.
 // As with other I/O devices, the raw physical disk is an asynchronous device --
 // requests to read or write portions of the disk return immediately,
@@ -25,12 +98,28 @@
 // This class provides the abstraction that for any individual thread
 // making a request, it waits around until the operation finishes before
 // returning.
+//
+// All requests go through a write-back cache of disk sectors: reads
+// of a cached sector and all writes complete without touching the
+// disk; modified sectors reach the disk when they are evicted, or when
+// Sync is called.
+//
+// Requests that do reach the disk are queued; whenever the disk
+// finishes one, the next is chosen according to the scheduling policy
+// -- except that requests for the same sector, if either is a write,
+// are always served in the order they were issued.
+// Threads do not hold the cache lock while they wait, so several of
+// them can have requests outstanding at once.
+
+class Journal;
 
 class SynchDisk : public CallBackObj {
   public:
-    SynchDisk();    		        // Initialize a synchronous disk,
+    SynchDisk(DiskSchedPolicy policy = DiskFCFS, bool mapped = FALSE);
+					// Initialize a synchronous disk,
 					// by initializing the raw Disk.
-    ~SynchDisk();			// De-allocate the synch disk data
+    ~SynchDisk();			// Write back the cache and de-allocate
+					// the synch disk data
     
     void ReadSector(int sectorNumber, char* data);
     					// Read/write a disk sector, returning
@@ -39,17 +128,184 @@ class SynchDisk : public CallBackObj {
     					// Disk::ReadRequest/WriteRequest and
 					// then wait until the request is done.
     void WriteSector(int sectorNumber, char* data);
+
+    void ReadSectors(int sectorNumber, int numSectors, char* data);
+    void WriteSectors(int sectorNumber, int numSectors, char* data);
+					// Read/write a run of consecutive
+					// sectors, with one disk request per
+					// run of uncached sectors
+
+    void ReadAhead(int sectorNumber, int numSectors);
+					// Start bringing consecutive sectors
+					// into the cache, without waiting
+
+    void Sync();			// Write every dirty cached sector
+					// back to the disk
     
     void CallBack();			// Called by the disk device interrupt
 					// handler, to signal that the
 					// current disk operation is complete.
 
+    void PrintStats();			// Print the request service latency
+
+    void SetJournal(Journal *log) { journal = log; }
+					// Journal the writes made inside
+					// transactions
+
   private:
+    friend class Journal;		// commits straight from the cache
+
     Disk *disk;		  		// Raw disk device
-    Semaphore *semaphore; 		// To synchronize requesting thread 
-					// with the interrupt handler
-    Lock *lock;		  		// Only one read/write request
-					// can be sent to the disk at a time
+    Journal *journal;			// Where transactions are logged,
+					// or NULL
+    Lock *lock;		  		// Protects the cache
+    Condition *ioDone;			// Signalled when a busy entry
+					// becomes available again
+
+    DiskSchedPolicy policy;		// How to order queued requests
+    List<DiskRequest *> *queue;		// Requests waiting for the disk
+    DiskRequest *active;		// Request being served, or NULL
+    bool sweepUp;			// SCAN: current direction of the head
+
+    int *latency;			// Service time (queueing + disk) of
+    int numLatency;			// every completed request, and
+    int maxLatency;			// the size of the array
+
+    CacheEntry *cache;			// The sector buffers
+    CacheEntry *buckets[NumCacheBuckets]; // Hash chains, by sector number
+    CacheEntry *lruHead;		// Most recently used entry
+    CacheEntry *lruTail;		// Least recently used entry
+    List<Prefetch *> *prefetches;	// Read-aheads not yet completed
+
+    CacheEntry *Lookup(int sectorNumber); // Find a cached sector, or NULL
+    CacheEntry *Find(int sectorNumber, bool *hit);
+					// Find or assign the (idle) entry
+					// for a sector
+    CacheEntry *Victim();		// LRU entry that is not busy, or NULL
+    void Reassign(CacheEntry *entry, int sectorNumber);
+					// Rehash a clean entry to a new sector
+    void Fill(CacheEntry *entry);	// Read a newly assigned entry in
+    void WriteBack(CacheEntry *entry);	// Write a dirty entry out
+    void Touch(CacheEntry *entry);	// Move entry to the front of the LRU
+    void Unhash(CacheEntry *entry);	// Take entry off its hash chain
+    void WaitIdle(CacheEntry *entry);	// Wait until a busy entry is not
+    void Complete(Prefetch *prefetch);	// Copy a read-ahead into the cache
+    void Reap();			// Complete any finished read-aheads
+    void Consume(CacheEntry *entry, bool used);
+					// Count a prefetched entry as hit,
+					// or as wasted
+
+    DiskRequest *Issue(int sectorNumber, char *data, int numSectors, 
+				bool writing);
+					// Queue a request for the raw disk
+    void Wait(DiskRequest *request);	// Wait for it to finish
+    void DiskRead(int sectorNumber, char *data, int numSectors = 1);
+    void DiskWrite(int sectorNumber, char *data, int numSectors = 1);
+					// Issue one request to the raw disk
+					// and wait for it to finish
+    void Start(DiskRequest *request);	// Hand a request to the raw disk
+    DiskRequest *NextRequest();		// Take the next request to serve
+					// off the queue, by policy
+    bool Overtakes(DiskRequest *request);
+					// Would serving it now pass an older
+					// request for the same sectors?
+};
+
+// Layout of the journal.  A group of transactions is committed with
+// one record, written with a single disk request at the head of the
+// log: descriptor sectors (LogMagic, sequence number, count, and the
+// home sector of each block), the blocks themselves, and a commit
+// sector (LogCommitMagic, sequence number, count).  The first sector
+// of the log region says which sequence number the log starts at.
+
+const int LogMagic = 0x4a524e4c;	// "JRNL"
+const int LogCommitMagic = 0x434d4954;	// "CMIT"
+const int MaxGroupBlocks = 96;		// most blocks one record can hold;
+					// also the most entries pinned in
+					// the cache at once
+const int MaxTransactionBlocks = 32;	// most blocks one transaction may
+					// log; set aside for each
+					// transaction joining a group
+
+// The following class defines the transaction a thread is in: how
+// deeply its Begins are nested, and how many sectors it has logged.
+
+class Transaction {
+  public:
+    Thread *thread;			// whose transaction it is
+    int depth;				// Begins not yet matched by an End
+    int logged;				// sectors added to the group by it
+};
+
+// The following class defines a write-ahead journal of metadata
+// sectors.  File system operations bracket their updates with Begin
+// and End; every sector a thread writes through the SynchDisk in
+// between is logged, and held in the cache until the transaction's
+// group is committed.  The group is committed when the last of the
+// transactions in it ends, so concurrent operations share one log
+// write.  A transaction may log at most MaxTransactionBlocks sectors,
+// and a group only takes in as many transactions as it has room for
+// at that size, so a group never overflows; operations that could
+// change more than that split themselves into several transactions.
+// Committed sectors go home lazily, as the cache writes them
+// back; only when the log fills up is the cache synced and the log
+// emptied (a checkpoint).  At mount, Recover reinstalls whatever
+// committed records the log holds.
+
+class Journal {
+  public:
+    Journal(int firstSector, int numSectors);
+					// The log occupies "numSectors"
+					// sectors from "firstSector" on
+    ~Journal();
+
+    void Format();			// Start out with an empty log
+    void Recover();			// Replay committed records, then
+					// empty the log
+
+    void Begin();			// Start a transaction (may wait for
+					// a commit or a checkpoint)
+    void End();				// Finish it; the last transaction
+					// of a group commits the group
+    void Checkpoint();			// Write everything home and empty
+					// the log; no transaction may be
+					// in progress
+
+    bool InTransaction();		// Is the current thread in one?
+    int Logged();			// # of sectors its transaction has
+					// logged so far
+    int Ticket();			// Stands for every change made so
+					// far, committed or not
+    void WaitCommitted(int ticket);	// Wait until they are committed
+    void Log(int sectorNumber);		// Add a sector to the current
+					// group, for the current thread's
+					// transaction.  Called with the
+					// SynchDisk lock held
+
+  private:
+    int start;				// First sector of the log region
+    int size;				// Its size in sectors
+    int head;				// Where the next record goes
+    int sequence;			// Sequence number of the next record
+
+    Lock *lock;				// Protects the fields below
+    Condition *changed;			// Signalled when a commit or
+					// checkpoint finishes
+    int outstanding;			// Transactions in the current group
+    bool committing;			// Commit or checkpoint under way?
+    List<Transaction *> *members;	// Transactions in progress, one
+					// per thread
+    int opened;				// # of groups started so far
+    int committed;			// # of them committed so far
+
+    int *group;				// Sectors logged by the current
+    int groupSize;			// group (under the SynchDisk lock)
+
+    Transaction *Find(Thread *thread);	// "thread"'s transaction, or NULL
+    void Commit();			// Write the group's record
+    void WriteStart();			// Write the first sector of the log
+    int RecordLength(int count);	// Sectors in a record of "count"
+					// blocks
 };
 
 #endif // SYNCHDISK_H
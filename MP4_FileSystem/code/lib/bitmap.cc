@@ -30,9 +30,30 @@ Bitmap::Bitmap(int numItems)
     for (i = 0; i < numWords; i++) {
 	map[i] = 0;		// initialize map to keep Purify happy
     }
-    for (i = 0; i < numBits; i++) {
-        Clear(i);
-    }
+    Recount();
+}
+
+//----------------------------------------------------------------------
+// Bitmap::Recount
+// 	Recompute the cached count of clear bits, one word at a time,
+//	and restart next-fit searches from the beginning.  Must be called
+//	whenever "map" is overwritten other than through Mark and Clear.
+//
+//	The unused bits at the end of the last word are kept set, so
+//	that whole-word tests never mistake them for free bits.
+//----------------------------------------------------------------------
+
+void
+Bitmap::Recount()
+{
+    int setBits = 0;
+
+    if (numBits % BitsInWord != 0)
+	map[numWords - 1] |= ~0u << (numBits % BitsInWord);
+    for (int i = 0; i < numWords; i++)
+	setBits += __builtin_popcount(map[i]);
+    numClear = numWords * BitsInWord - setBits;
+    nextFit = 0;
 }
 
 //----------------------------------------------------------------------
@@ -57,6 +78,8 @@ Bitmap::Mark(int which)
 { 
     ASSERT(which >= 0 && which < numBits);
 
+    if (!Test(which))
+	numClear--;
     map[which / BitsInWord] |= 1 << (which % BitsInWord);
 
     ASSERT(Test(which));
@@ -74,6 +97,8 @@ Bitmap::Clear(int which)
 {
     ASSERT(which >= 0 && which < numBits);
 
+    if (Test(which))
+	numClear++;
     map[which / BitsInWord] &= ~(1 << (which % BitsInWord));
 
     ASSERT(!Test(which));
@@ -100,20 +125,110 @@ Bitmap::Test(int which) const
 
 //----------------------------------------------------------------------
 // Bitmap::FindAndSet
-// 	Return the number of the first bit which is clear.
+// 	Return the number of the first clear bit at or after the next-fit
+//	position, wrapping around to the start of the map if necessary.
 //	As a side effect, set the bit (mark it as in use).
 //	(In other words, find and allocate a bit.)
 //
+//	Full words are skipped whole; within a word, the first clear bit
+//	is the number of trailing ones.
+//
 //	If no bits are clear, return -1.
 //----------------------------------------------------------------------
 
 int 
 Bitmap::FindAndSet() 
 {
-    for (int i = 0; i < numBits; i++) {
-	if (!Test(i)) {
-	    Mark(i);
-	    return i;
+    int word, which;
+    unsigned int bits;
+
+    if (numClear == 0)
+	return -1;
+
+    // in the first word, treat the bits before the cursor as set
+    word = nextFit / BitsInWord;
+    bits = map[word] | ((1u << (nextFit % BitsInWord)) - 1);
+    for (int i = 0; i <= numWords; i++) {
+	if (bits != ~0u) {
+	    which = word * BitsInWord + __builtin_ctz(~bits);
+	    Mark(which);
+	    nextFit = (which + 1) % numBits;
+	    return which;
+	}
+	word = (word + 1) % numWords;
+	bits = map[word];
+    }
+    ASSERTNOTREACHED();		// numClear said there was a clear bit
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// Bitmap::FindRun
+// 	Return the number of the first bit of a run of "count" clear
+//	bits, searching from the next-fit position to the end of the map
+//	and then from the start.  The bits are not set; the caller marks
+//	the ones it uses.  The next search will start after the run.
+//
+//	If there is no such run, return -1.
+//
+//	"count" is the number of consecutive clear bits wanted
+//----------------------------------------------------------------------
+
+int
+Bitmap::FindRun(int count)
+{
+    int firstWord = nextFit / BitsInWord;
+    int start;
+
+    ASSERT(count > 0);
+    if (count > numClear)
+	return -1;
+
+    start = ScanRun(firstWord, numWords, count);
+    if (start == -1)		// wrap around, including runs that
+				// straddle the starting word
+	start = ScanRun(0, min(numWords,
+		firstWord + divRoundUp(count, BitsInWord) + 1), count);
+    if (start != -1)
+	nextFit = (start + count) % numBits;
+    return start;
+}
+
+//----------------------------------------------------------------------
+// Bitmap::ScanRun
+// 	Look for "count" consecutive clear bits in words "firstWord"
+//	up to (not including) "lastWord".  Words that are all clear or
+//	all set are handled whole; only mixed words are looked at bit
+//	by bit.  Return the first bit of the run, or -1.
+//----------------------------------------------------------------------
+
+int
+Bitmap::ScanRun(int firstWord, int lastWord, int count) const
+{
+    int runStart = 0, runLength = 0;
+
+    for (int word = firstWord; word < lastWord; word++) {
+	unsigned int bits = map[word];
+
+	if (bits == 0) {		// whole word free
+	    if (runLength == 0)
+		runStart = word * BitsInWord;
+	    runLength += BitsInWord;
+	    if (runLength >= count)
+		return runStart;
+	} else if (bits == ~0u) {	// whole word in use
+	    runLength = 0;
+	} else {
+	    for (int bit = 0; bit < BitsInWord; bit++) {
+		if (bits & (1u << bit)) {
+		    runLength = 0;
+		} else {
+		    if (runLength == 0)
+			runStart = word * BitsInWord + bit;
+		    if (++runLength == count)
+			return runStart;
+		}
+	    }
 	}
     }
     return -1;
@@ -123,19 +238,13 @@ Bitmap::FindAndSet()
 // Bitmap::NumClear
 // 	Return the number of clear bits in the bitmap.
 //	(In other words, how many bits are unallocated?)
+//	The count is maintained by Mark, Clear and Recount.
 //----------------------------------------------------------------------
 
 int 
 Bitmap::NumClear() const
 {
-    int count = 0;
-
-    for (int i = 0; i < numBits; i++) {
-	if (!Test(i)) {
-	    count++;
-	}
-    }
-    return count;
+    return numClear;
 }
 
 //----------------------------------------------------------------------
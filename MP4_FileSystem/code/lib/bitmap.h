@@ -8,6 +8,11 @@
 //	The bitmap can be parameterized with with the number of bits being 
 //	managed.
 //
+//	Searches work a word at a time, and the number of clear bits is
+//	kept up to date as bits change, so that allocators working on
+//	large maps (such as the free map of the disk) do not have to
+//	look at every bit.
+//
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -34,14 +39,18 @@ class Bitmap {
   public:
     Bitmap(int numItems);	// Initialize a bitmap, with "numItems" bits
 				// initially, all bits are cleared.
-    ~Bitmap();			// De-allocate bitmap
+    virtual ~Bitmap();		// De-allocate bitmap
     
-    void Mark(int which);   	// Set the "nth" bit
-    void Clear(int which);  	// Clear the "nth" bit
+    virtual void Mark(int which);   	// Set the "nth" bit
+    virtual void Clear(int which);  	// Clear the "nth" bit
     bool Test(int which) const;	// Is the "nth" bit set?
-    int FindAndSet();         // Return the # of a clear bit, and as a side
+    virtual int FindAndSet(); // Return the # of a clear bit, and as a side
 				// effect, set the bit. 
 				// If no bits are clear, return -1.
+    virtual int FindRun(int count);
+				// Return the # of the first bit of a run
+				// of "count" clear bits, or -1 if there
+				// is none.  The bits are left clear.
     int NumClear() const;	// Return the number of clear bits
 
     void Print() const;		// Print contents of bitmap
@@ -54,6 +63,15 @@ class Bitmap {
 				//  multiple of the number of bits in
 				//  a word)
     unsigned int *map;		// bit storage
+    int numClear;		// number of clear bits, kept current
+    int nextFit;		// where the next search starts; searches
+				// continue from the last allocation
+				// (next-fit) and wrap around
+
+    void Recount();		// Recompute numClear after "map" has
+				// been overwritten wholesale
+    int ScanRun(int firstWord, int lastWord, int count) const;
+				// Search part of the map for a run
 };
 
 #endif // BITMAP_H
@@ -32,6 +32,8 @@
 #include <sys/file.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/mman.h>
+#include <dirent.h>
 #include <cerrno>
 
 #ifdef SOLARIS
@@ -194,6 +196,22 @@ RandomNumber()
     return rand();
 }
 
+//----------------------------------------------------------------------
+// HostTime
+// 	Return the wall-clock time on the host, in microseconds.  This
+//	has nothing to do with simulated time; it is for measuring how
+//	long the simulation itself takes.
+//----------------------------------------------------------------------
+
+long
+HostTime()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000L + tv.tv_usec;
+}
+
 //----------------------------------------------------------------------
 // AllocBoundedArray
 // 	Return an array, with the two pages just before 
@@ -421,6 +439,91 @@ Unlink(char *name)
     return unlink(name);
 }
 
+//----------------------------------------------------------------------
+// OpenDir
+// 	Open a UNIX directory to list its entries.  Return NULL if there
+//	is no such directory.
+//----------------------------------------------------------------------
+
+void *
+OpenDir(char *name)
+{
+    return (void *) opendir(name);
+}
+
+//----------------------------------------------------------------------
+// NextDirEntry
+// 	Return the name of the next entry of a directory opened with
+//	OpenDir, skipping "." and "..", or NULL if there are no more.
+//	The name is only good until the next call.
+//----------------------------------------------------------------------
+
+char *
+NextDirEntry(void *dir)
+{
+    struct dirent *entry;
+
+    while ((entry = readdir((DIR *) dir)) != NULL) {
+	if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+	    return entry->d_name;
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// CloseDir
+// 	Close a directory opened with OpenDir.
+//----------------------------------------------------------------------
+
+void
+CloseDir(void *dir)
+{
+    closedir((DIR *) dir);
+}
+
+//----------------------------------------------------------------------
+// MapFile
+// 	Map the first "nBytes" of an open file into memory, shared, so
+//	that stores to the mapping change the file.  Abort if it fails.
+//----------------------------------------------------------------------
+
+char *
+MapFile(int fd, int nBytes)
+{
+    void *addr = mmap(NULL, nBytes, PROT_READ | PROT_WRITE, MAP_SHARED, 
+			fd, 0);
+
+    ASSERT(addr != MAP_FAILED);
+    return (char *) addr;
+}
+
+//----------------------------------------------------------------------
+// SyncMap
+// 	Write whatever has changed in a mapping back to the file, and
+//	wait for it to get there.
+//----------------------------------------------------------------------
+
+void
+SyncMap(char *addr, int nBytes)
+{
+    int retVal = msync(addr, nBytes, MS_SYNC);
+
+    ASSERT(retVal == 0);
+}
+
+//----------------------------------------------------------------------
+// UnmapFile
+// 	Undo a mapping made by MapFile.
+//----------------------------------------------------------------------
+
+void
+UnmapFile(char *addr, int nBytes)
+{
+    int retVal = munmap(addr, nBytes);
+
+    ASSERT(retVal == 0);
+}
+
 //----------------------------------------------------------------------
 // OpenSocket
 // 	Open an interprocess communication (IPC) connection.  For now, 
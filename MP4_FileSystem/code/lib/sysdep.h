@@ -32,6 +32,9 @@ extern void CallOnUserAbort(void (*cleanup)(int));
 extern void RandomInit(unsigned seed);
 extern unsigned int RandomNumber();
 
+// Read the host's wall clock, in microseconds (not simulated time!)
+extern long HostTime();
+
 // Allocate, de-allocate an array, such that de-referencing
 // just beyond either end of the array will cause an error
 extern char *AllocBoundedArray(int size);
@@ -53,6 +56,19 @@ extern int Tell(int fd);
 extern int Close(int fd);
 extern bool Unlink(char *name);
 
+// List the entries of a UNIX directory, other than "." and "..".
+// OpenDir returns NULL if "name" is not a directory; NextDirEntry
+// returns NULL after the last entry.
+extern void *OpenDir(char *name);
+extern char *NextDirEntry(void *dir);
+extern void CloseDir(void *dir);
+
+// Map a whole open file into memory, push changes made through the
+// mapping back to the file, and undo the mapping.
+extern char *MapFile(int fd, int nBytes);
+extern void SyncMap(char *addr, int nBytes);
+extern void UnmapFile(char *addr, int nBytes);
+
 // Other C library routines that are used by Nachos.
 // These are assumed to be portable, so we don't include a wrapper.
 extern "C" {
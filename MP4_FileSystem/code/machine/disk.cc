@@ -35,9 +35,10 @@ const int DiskSize = (MagicSize + (NumSectors * SectorSize));
 // 	ok to treat it as Nachos disk storage.
 //
 //	"toCall" -- object to call when disk read/write request completes
+//	"mapped" -- should the file be mapped into memory?
 //----------------------------------------------------------------------
 
-Disk::Disk(CallBackObj *toCall)
+Disk::Disk(CallBackObj *toCall, bool mapped)
 {
     int magicNum;
     int tmp = 0;
@@ -61,17 +62,26 @@ Disk::Disk(CallBackObj *toCall)
         Lseek(fileno, DiskSize - sizeof(int), 0);	
 	WriteFile(fileno, (char *)&tmp, sizeof(int));  
     }
+    image = NULL;
+    if (mapped) {
+	DEBUG(dbgDisk, "Mapping " << diskname << " into memory.");
+	image = MapFile(fileno, DiskSize);
+    }
     active = FALSE;
 }
 
 //----------------------------------------------------------------------
 // Disk::~Disk()
 // 	Clean up disk simulation, by closing the UNIX file representing the
-//	disk.
+//	disk.  A mapped file is flushed to the file first.
 //----------------------------------------------------------------------
 
 Disk::~Disk()
 {
+    if (image != NULL) {
+	SyncMap(image, DiskSize);
+	UnmapFile(image, DiskSize);
+    }
     Close(fileno);
 }
 
@@ -97,55 +107,78 @@ PrintSector (bool writing, int sector, char *data)
 
 //----------------------------------------------------------------------
 // Disk::ReadRequest/WriteRequest
-// 	Simulate a request to read/write a single disk sector
+// 	Simulate a request to read/write a run of consecutive disk sectors
 //	   Do the read/write immediately to the UNIX file
 //	   Set up an interrupt handler to be called later,
 //	      that will notify the caller when the simulator says
 //	      the operation has completed.
 //
+//	A multi-sector request pays for one seek and rotational delay,
+//	and then one sector transfer time per sector (plus a track-to-
+//	track seek whenever the run crosses onto the next track); it
+//	completes with a single interrupt.
+//
 //	Note that a disk only allows an entire sector to be read/written,
 //	not part of a sector.
 //
-//	"sectorNumber" -- the disk sector to read/write
+//	A mapped disk copies the sectors to/from the mapping instead of
+//	going through the UNIX file.
+//
+//	"sectorNumber" -- the first disk sector to read/write
 //	"data" -- the bytes to be written, the buffer to hold the incoming bytes
+//	"numSectors" -- the number of consecutive sectors to transfer
 //----------------------------------------------------------------------
 
 void
-Disk::ReadRequest(int sectorNumber, char* data)
+Disk::ReadRequest(int sectorNumber, char* data, int numSectors)
 {
-    int ticks = ComputeLatency(sectorNumber, FALSE);
+    int ticks = ComputeLatency(sectorNumber, numSectors, FALSE);
 
     ASSERT(!active);				// only one request at a time
-    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
+    ASSERT((sectorNumber >= 0) && (numSectors > 0)
+		&& (sectorNumber + numSectors <= NumSectors));
     
-    DEBUG(dbgDisk, "Reading from sector " << sectorNumber);
-    Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
-    Read(fileno, data, SectorSize);
+    DEBUG(dbgDisk, "Reading " << numSectors << " sectors from sector " << sectorNumber);
+    if (image != NULL)
+	bcopy(image + SectorSize * sectorNumber + MagicSize, data,
+				SectorSize * numSectors);
+    else {
+	Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
+	Read(fileno, data, SectorSize * numSectors);
+    }
     if (debug->IsEnabled('d'))
-	PrintSector(FALSE, sectorNumber, data);
+	for (int i = 0; i < numSectors; i++)
+	    PrintSector(FALSE, sectorNumber + i, data + i * SectorSize);
     
     active = TRUE;
-    UpdateLast(sectorNumber);
+    UpdateLast(sectorNumber, numSectors, ticks);
     kernel->stats->numDiskReads++;
     kernel->interrupt->Schedule(this, ticks, DiskInt);
 }
 
 void
-Disk::WriteRequest(int sectorNumber, char* data)
+Disk::WriteRequest(int sectorNumber, char* data, int numSectors)
 {
-    int ticks = ComputeLatency(sectorNumber, TRUE);
+    int ticks = ComputeLatency(sectorNumber, numSectors, TRUE);
 
     ASSERT(!active);
-    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
+    ASSERT((sectorNumber >= 0) && (numSectors > 0)
+		&& (sectorNumber + numSectors <= NumSectors));
     
-    DEBUG(dbgDisk, "Writing to sector " << sectorNumber);
-    Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
-    WriteFile(fileno, data, SectorSize);
+    DEBUG(dbgDisk, "Writing " << numSectors << " sectors to sector " << sectorNumber);
+    if (image != NULL)
+	bcopy(data, image + SectorSize * sectorNumber + MagicSize,
+				SectorSize * numSectors);
+    else {
+	Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
+	WriteFile(fileno, data, SectorSize * numSectors);
+    }
     if (debug->IsEnabled('d'))
-	PrintSector(TRUE, sectorNumber, data);
+	for (int i = 0; i < numSectors; i++)
+	    PrintSector(TRUE, sectorNumber + i, data + i * SectorSize);
     
     active = TRUE;
-    UpdateLast(sectorNumber);
+    UpdateLast(sectorNumber, numSectors, ticks);
     kernel->stats->numDiskWrites++;
     kernel->interrupt->Schedule(this, ticks, DiskInt);
 }
@@ -249,6 +282,25 @@ Disk::ComputeLatency(int newSector, bool writing)
     return(seek + rotation + RotationTime);
 }
 
+//----------------------------------------------------------------------
+// Disk::ComputeLatency()
+// 	Return how long it will take to read/write a run of "numSectors"
+//	consecutive sectors starting at "newSector": the latency of the
+//	first sector, then one RotationTime for each further sector, and
+//	a one-track seek each time the run crosses onto the next track.
+//----------------------------------------------------------------------
+
+int
+Disk::ComputeLatency(int newSector, int numSectors, bool writing)
+{
+    int lastSector = newSector + numSectors - 1;
+    int tracksCrossed = lastSector / SectorsPerTrack 
+				- newSector / SectorsPerTrack;
+
+    return ComputeLatency(newSector, writing) 
+		+ (numSectors - 1) * RotationTime + tracksCrossed * SeekTime;
+}
+
 //----------------------------------------------------------------------
 // Disk::UpdateLast
 //   	Keep track of the most recently requested sector.  So we can know
@@ -261,8 +313,34 @@ Disk::UpdateLast(int newSector)
     int rotate;
     int seek = TimeToSeek(newSector, &rotate);
     
-    if (seek != 0)
+    if (seek != 0) {
 	bufferInit = kernel->stats->totalTicks + seek + rotate;
+	kernel->stats->numDiskSeeks++;
+	kernel->stats->numSeekTracks += seek / SeekTime;
+    }
     lastSector = newSector;
     DEBUG(dbgDisk, "Updating last sector = " << lastSector << " , " << bufferInit);
 }
+
+//----------------------------------------------------------------------
+// Disk::UpdateLast
+//   	Keep track of where the head is left by a request for a run of
+//	"numSectors" sectors, that takes "ticks" to complete.  If the run
+//	spilled onto later tracks, the track buffer only starts filling
+//	once the transfer is over.
+//----------------------------------------------------------------------
+
+void
+Disk::UpdateLast(int newSector, int numSectors, int ticks)
+{
+    int last = newSector + numSectors - 1;
+    int tracksCrossed = last / SectorsPerTrack - newSector / SectorsPerTrack;
+
+    UpdateLast(newSector);
+    if (tracksCrossed > 0) {
+	bufferInit = kernel->stats->totalTicks + ticks;
+	kernel->stats->numDiskSeeks += tracksCrossed;
+	kernel->stats->numSeekTracks += tracksCrossed;
+    }
+    lastSector = last;
+}
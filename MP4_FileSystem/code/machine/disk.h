@@ -34,6 +34,11 @@
 // and an interrupt is invoked later to signal that the operation completed.
 //
 // The physical disk is in fact simulated via operations on a UNIX file.
+// Normally each request is a seek plus a read or write of that file;
+// a disk created "mapped" instead maps the whole file into memory once
+// and copies sectors in and out of the mapping, which saves a pair of
+// system calls per request.  Either way the simulated timing and the
+// interrupts are the same.
 //
 // To make life a little more realistic, the simulated time for
 // each operation reflects a "track buffer" -- RAM to store the contents
@@ -53,19 +58,35 @@ const int NumTracks = 32768;		// number of tracks per disk
 const int NumSectors = (SectorsPerTrack * NumTracks);
 					// total # of sectors per disk
 
+// Orders in which SynchDisk can serve queued disk requests.  All but
+// FCFS look at the track of each request relative to the disk head.
+
+enum DiskSchedPolicy {
+    DiskFCFS,				// first come, first served
+    DiskSSTF,				// shortest seek (track distance) first
+    DiskSCAN,				// elevator: sweep up, then back down
+    DiskCLOOK				// sweep up only, then jump back to
+					// the lowest pending track
+};
+
 class Disk : public CallBackObj {
   public:
-    Disk(CallBackObj *toCall);          // Create a simulated disk.  
+    Disk(CallBackObj *toCall, bool mapped = FALSE);
+					// Create a simulated disk.  
 					// Invoke toCall->CallBack() 
 					// when each request completes.
+					// If "mapped", keep the UNIX file
+					// mapped into memory.
     ~Disk();				// Deallocate the disk.
     
-    void ReadRequest(int sectorNumber, char* data);
-    					// Read/write an single disk sector.
+    void ReadRequest(int sectorNumber, char* data, int numSectors = 1);
+    					// Read/write "numSectors" consecutive
+					// disk sectors (by default, a single
+					// sector) to/from "data".
 					// These routines send a request to 
     					// the disk and return immediately.
     					// Only one request allowed at a time!
-    void WriteRequest(int sectorNumber, char* data);
+    void WriteRequest(int sectorNumber, char* data, int numSectors = 1);
 
     void CallBack();			// Invoked when disk request 
 					// finishes. In turn calls, callWhenDone.
@@ -74,10 +95,19 @@ class Disk : public CallBackObj {
     					// Return how long a request to 
 					// newSector will take: 
 					// (seek + rotational delay + transfer)
+    int ComputeLatency(int newSector, int numSectors, bool writing);
+					// Same, for a run of sectors: one
+					// seek and rotational delay, then
+					// one transfer time per sector
+    int HeadTrack() { return lastSector / SectorsPerTrack; }
+					// Track the head was left over by
+					// the last request
 
   private:
     int fileno;				// UNIX file number for simulated disk 
     char diskname[32];			// name of simulated disk's file
+    char *image;			// the file mapped into memory, or
+					// NULL to use read/write
     CallBackObj *callWhenDone;		// Invoke when any disk request finishes
     bool active;     			// Is a disk operation in progress?
     int lastSector;			// The previous disk request 
@@ -87,6 +117,7 @@ class Disk : public CallBackObj {
     int TimeToSeek(int newSector, int *rotate); // time to get to the new track
     int ModuloDiff(int to, int from);        // # sectors between to and from
     void UpdateLast(int newSector);
+    void UpdateLast(int newSector, int numSectors, int ticks);
 };
 
 #endif // DISK_H
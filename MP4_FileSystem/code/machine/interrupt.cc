@@ -242,9 +242,8 @@ Interrupt::Halt()
     cout << "This is halt\n";
     kernel->stats->Print();
 	*/
-	delete debug;
-	
-    delete kernel;	// Never returns.
+    delete kernel;	// Never returns; also frees "debug" once the
+			// disk cache has been written back.
 }
 
 #ifdef FILESYS_STUB
@@ -385,7 +384,27 @@ int Interrupt::Write(char *buffer, int size, OpenFileId id)
 {
     return kernel -> Write(buffer, size, id);
 }
+int Interrupt::Seek(int position, OpenFileId id)
+{
+    return kernel -> Seek(position, id);
+}
 int Interrupt::Close(OpenFileId id)
 {
     return kernel -> Close(id);
+}
+int Interrupt::Remove(char *filename)
+{
+    return kernel -> Remove(filename);
+}
+int Interrupt::AioRead(char *buffer, int size, OpenFileId id)
+{
+    return kernel -> AioRead(buffer, size, id);
+}
+int Interrupt::AioWrite(char *buffer, int size, OpenFileId id)
+{
+    return kernel -> AioWrite(buffer, size, id);
+}
+int Interrupt::AioWait(int aio)
+{
+    return kernel -> AioWait(aio);
 }
\ No newline at end of file
@@ -102,7 +102,12 @@ class Interrupt {
     OpenFileId Open(char *filename);
     int Read(char *buffer, int size, OpenFileId id);
     int Write(char *buffer, int size, OpenFileId id);
+    int Seek(int position, OpenFileId id);
     int Close(OpenFileId id);
+    int Remove(char *filename);
+    int AioRead(char *buffer, int size, OpenFileId id);
+    int AioWrite(char *buffer, int size, OpenFileId id);
+    int AioWait(int aio);
 
 	#ifdef FILESYS_STUB
 	int CreateFile(char *filename);
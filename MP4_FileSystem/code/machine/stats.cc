@@ -19,7 +19,13 @@
 Statistics::Statistics()
 {
     totalTicks = idleTicks = systemTicks = userTicks = 0;
-    numDiskReads = numDiskWrites = 0;
+    numDiskReads = numDiskWrites = numDiskSeeks = numSeekTracks = 0;
+    numCacheHits = numCacheMisses = numCacheEvictions = 0;
+    numPrefetched = numPrefetchHits = numPrefetchWasted = 0;
+    numDentryHits = numDentryMisses = 0;
+    numHeaderHits = numHeaderMisses = 0;
+    numJournalCommits = numJournalBlocks = 0;
+    numJournalCheckpoints = numJournalReplayed = 0;
     numConsoleCharsRead = numConsoleCharsWritten = 0;
     numPageFaults = numPacketsSent = numPacketsRecvd = 0;
 }
@@ -36,7 +42,23 @@ Statistics::Print()
     cout << "Ticks: total " << totalTicks << ", idle " << idleTicks;
 		cout << ", system " << systemTicks << ", user " << userTicks <<"\n";
     cout << "Disk I/O: reads " << numDiskReads;
-		cout << ", writes " << numDiskWrites << "\n";
+		cout << ", writes " << numDiskWrites;
+		cout << ", seeks " << numDiskSeeks;
+		cout << " (" << numSeekTracks << " tracks)\n";
+    cout << "Disk cache: hits " << numCacheHits;
+		cout << ", misses " << numCacheMisses;
+		cout << ", evictions " << numCacheEvictions << "\n";
+    cout << "Read-ahead: sectors " << numPrefetched;
+		cout << ", hits " << numPrefetchHits;
+		cout << ", wasted " << numPrefetchWasted << "\n";
+    cout << "Dentry cache: hits " << numDentryHits;
+		cout << ", misses " << numDentryMisses << "\n";
+    cout << "Header cache: hits " << numHeaderHits;
+		cout << ", misses " << numHeaderMisses << "\n";
+    cout << "Journal: commits " << numJournalCommits;
+		cout << ", blocks " << numJournalBlocks;
+		cout << ", checkpoints " << numJournalCheckpoints;
+		cout << ", replayed " << numJournalReplayed << "\n";
 		cout << "Console I/O: reads " << numConsoleCharsRead;
     cout << ", writes " << numConsoleCharsWritten << "\n";
     cout << "Paging: faults " << numPageFaults << "\n";
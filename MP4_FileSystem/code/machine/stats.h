@@ -30,6 +30,23 @@ class Statistics {
 
     int numDiskReads;		// number of disk read requests
     int numDiskWrites;		// number of disk write requests
+    int numDiskSeeks;		// number of requests that changed track
+    int numSeekTracks;		// number of tracks those seeks crossed
+    int numCacheHits;		// disk sector requests found in the cache
+    int numCacheMisses;		// disk sector requests not in the cache
+    int numCacheEvictions;	// cached sectors replaced to make room
+    int numPrefetched;		// sectors read ahead into the cache
+    int numPrefetchHits;	// read-ahead sectors later read
+    int numPrefetchWasted;	// read-ahead sectors evicted or overwritten
+				// before anyone read them
+    int numDentryHits;		// directory lookups found in the dentry cache
+    int numDentryMisses;	// directory lookups that read the directory
+    int numHeaderHits;		// file opens that found the header in core
+    int numHeaderMisses;	// file opens that read the header
+    int numJournalCommits;	// records written to the journal
+    int numJournalBlocks;	// sectors logged in those records
+    int numJournalCheckpoints;	// times the journal was emptied
+    int numJournalReplayed;	// sectors reinstalled by recovery
     int numConsoleCharsRead;	// number of characters read from the keyboard
     int numConsoleCharsWritten; // number of characters written to the display
     int numPageFaults;		// number of virtual memory page faults
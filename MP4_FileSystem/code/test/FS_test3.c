@@ -0,0 +1,41 @@
+#include "syscall.h"
+
+/* Copy /src to /dst through two open files at once, read /src back
+ * through a second id while the first is still open, then remove it
+ * while open: reads through the open ids must keep working.
+ */
+int main(void)
+{
+	char data[] = "abcdefghijklmnopqrstuvwxyz";
+	char buf[26];
+	OpenFileId src, dst, again;
+	int i, n;
+
+	if (Create("/src", 0) != 1) MSG("Failed on creating /src");
+	if (Create("/dst", 0) != 1) MSG("Failed on creating /dst");
+	src = Open("/src");
+	dst = Open("/dst");
+	if (src < 2 || dst < 2 || src == dst) MSG("Failed on opening files");
+
+	for (i = 0; i < 10; ++i)
+		if (Write(data, 26, src) != 26) MSG("Failed on writing /src");
+
+	if (Seek(0, src) != 1) MSG("Failed on seeking /src");
+	while ((n = Read(buf, 26, src)) > 0)
+		if (Write(buf, n, dst) != n) MSG("Failed on writing /dst");
+
+	again = Open("/src");
+	if (again == src || again == dst) MSG("Failed on reopening /src");
+	if (Remove("/src") != 1) MSG("Failed on removing /src");
+	if (Open("/src") != -1) MSG("Removed file can still be opened");
+
+	if (Seek(130, again) != 1) MSG("Failed on seeking /src");
+	if (Read(buf, 26, again) != 26) MSG("Failed on reading removed /src");
+	for (i = 0; i < 26; ++i)
+		if (buf[i] != data[i]) MSG("Wrong data in removed /src");
+
+	if (Close(src) != 1 || Close(again) != 1 || Close(dst) != 1)
+		MSG("Failed on closing files");
+	if (Close(dst) != -1) MSG("Closed a file twice");
+	Halt();
+}
@@ -0,0 +1,62 @@
+#include "syscall.h"
+
+#define ChunkSize	1024
+#define NumChunks	32
+
+/* Write /aio with asynchronous writes, then read it back double-buffered:
+ * while one chunk is on its way in from the disk, checksum the one that
+ * arrived before.  Run with -st; with the disk busy behind the program's
+ * back, the idle ticks should stay well below the blocking version's.
+ */
+char buf[2][ChunkSize];
+
+int work(char *p, int n)
+{
+	int i, j, sum = 0;
+
+	for (i = 0; i < n; ++i)
+		for (j = 0; j < 8; ++j)
+			sum = sum * 31 + p[i] + j;
+	return sum;
+}
+
+int main(void)
+{
+	OpenFileId fd;
+	AioId aio[2];
+	int i, j, cur;
+
+	if (Create("/aio", 0) != 1) MSG("Failed on creating /aio");
+	fd = Open("/aio");
+	if (fd < 2) MSG("Failed on opening /aio");
+
+	for (i = 0; i < NumChunks; ++i) {
+		cur = i % 2;
+		if (i >= 2 && AioWait(aio[cur]) != ChunkSize)
+			MSG("Failed on writing /aio");
+		for (j = 0; j < ChunkSize; ++j)
+			buf[cur][j] = 'a' + (i + j) % 26;
+		aio[cur] = AioWrite(buf[cur], ChunkSize, fd);
+		if (aio[cur] < 0) MSG("Failed on starting a write");
+	}
+	if (AioWait(aio[0]) != ChunkSize || AioWait(aio[1]) != ChunkSize)
+		MSG("Failed on writing /aio");
+
+	if (Seek(0, fd) != 1) MSG("Failed on seeking /aio");
+	aio[0] = AioRead(buf[0], ChunkSize, fd);
+	for (i = 0; i < NumChunks; ++i) {
+		cur = i % 2;
+		if (AioWait(aio[cur]) != ChunkSize)
+			MSG("Failed on reading /aio");
+		if (i + 1 < NumChunks)
+			aio[1 - cur] = AioRead(buf[1 - cur], ChunkSize, fd);
+		for (j = 0; j < ChunkSize; ++j)
+			if (buf[cur][j] != 'a' + (i + j) % 26)
+				MSG("Wrong data in /aio");
+		work(buf[cur], ChunkSize);
+	}
+	if (AioWait(aio[0]) != -1) MSG("Waited for a transfer twice");
+
+	if (Close(fd) != 1) MSG("Failed on closing /aio");
+	Halt();
+}
@@ -32,7 +32,11 @@ Kernel::Kernel(int argc, char **argv)
     consoleOut = NULL;         // default is stdout
 #ifndef FILESYS_STUB
     formatFlag = FALSE;
+    preallocSectors = DefaultPreallocSectors;
 #endif
+    diskPolicy = DiskFCFS;      // serve disk requests in arrival order
+    mapDisk = FALSE;            // read and write the DISK file
+    printStats = FALSE;
     reliability = 1;            // network reliability, default is 1.0
     hostName = 0;               // machine id, also UNIX socket name
                                 // 0 is the default machine id
@@ -63,7 +67,29 @@ Kernel::Kernel(int argc, char **argv)
 #ifndef FILESYS_STUB
 		} else if (strcmp(argv[i], "-f") == 0) {
 	    	formatFlag = TRUE;
+		} else if (strcmp(argv[i], "-pa") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	preallocSectors = atoi(argv[i + 1]);
+	    	ASSERT(preallocSectors > 0);
+	    	i++;
 #endif
+        } else if (strcmp(argv[i], "-ds") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	if (strcmp(argv[i + 1], "fcfs") == 0)
+		    diskPolicy = DiskFCFS;
+	    	else if (strcmp(argv[i + 1], "sstf") == 0)
+		    diskPolicy = DiskSSTF;
+	    	else if (strcmp(argv[i + 1], "scan") == 0)
+		    diskPolicy = DiskSCAN;
+	    	else if (strcmp(argv[i + 1], "clook") == 0)
+		    diskPolicy = DiskCLOOK;
+	    	else
+		    cout << "Unknown disk scheduling policy " << argv[i + 1] << "\n";
+	    	i++;
+		} else if (strcmp(argv[i], "-dm") == 0) {
+	    	mapDisk = TRUE;
+		} else if (strcmp(argv[i], "-st") == 0) {
+	    	printStats = TRUE;
         } else if (strcmp(argv[i], "-n") == 0) {
             ASSERT(i + 1 < argc);   // next argument is float
             reliability = atof(argv[i + 1]);
@@ -77,8 +103,9 @@ Kernel::Kernel(int argc, char **argv)
 	   		cout << "Partial usage: nachos [-s]\n";
             cout << "Partial usage: nachos [-ci consoleIn] [-co consoleOut]\n";
 #ifndef FILESYS_STUB
-	    	cout << "Partial usage: nachos [-nf]\n";
+	    	cout << "Partial usage: nachos [-nf] [-pa #]\n";
 #endif
+            cout << "Partial usage: nachos [-ds fcfs|sstf|scan|clook] [-dm] [-st]\n";
             cout << "Partial usage: nachos [-n #] [-m #]\n";
 		}
     }
@@ -109,11 +136,12 @@ Kernel::Initialize()
     machine = new Machine(debugUserProg);
     synchConsoleIn = new SynchConsoleInput(consoleIn); // input from stdin
     synchConsoleOut = new SynchConsoleOutput(consoleOut); // output to stdout
-    synchDisk = new SynchDisk();    //
+    synchDisk = new SynchDisk(diskPolicy, mapDisk);
 #ifdef FILESYS_STUB
     fileSystem = new FileSystem();
 #else
-    fileSystem = new FileSystem(formatFlag);
+    openFileTable = new OpenFileTable();
+    fileSystem = new FileSystem(formatFlag, preallocSectors);
 #endif // FILESYS_STUB
 
 	// MP4 mod tag
@@ -146,6 +174,19 @@ Kernel::PrepareToEnd()
 
 Kernel::~Kernel()
 {
+    // the file system and the disk cache go first: shutting them down
+    // writes back cached sectors, which needs the interrupt, scheduler
+    // and statistics to still be around
+    delete fileSystem;
+#ifndef FILESYS_STUB
+    delete openFileTable;
+#endif
+    if (printStats) {
+	synchDisk->Sync();
+	stats->Print();
+	synchDisk->PrintStats();
+    }
+    delete synchDisk;
     delete stats;
     delete interrupt;
     delete scheduler;
@@ -153,21 +194,20 @@ Kernel::~Kernel()
     delete machine;
     delete synchConsoleIn;
     delete synchConsoleOut;
-    delete synchDisk;
-    delete fileSystem;
 	
 	// Mp4 mod tag
 	/*
     delete postOfficeIn;
     delete postOfficeOut;
     */
+	delete debug;
 	
     Exit(0);
 }
 
 //----------------------------------------------------------------------
 // Kernel::ThreadSelfTest
-//      Test threads, semaphores, synchlists
+//      Test threads, semaphores, synchlists, and the open file table
 //----------------------------------------------------------------------
 
 void
@@ -190,6 +230,10 @@ Kernel::ThreadSelfTest() {
    synchList->SelfTest(9);
    delete synchList;
 
+#ifndef FILESYS_STUB
+   				// test two threads opening one file
+   openFileTable->SelfTest();
+#endif // FILESYS_STUB
 }
 
 //----------------------------------------------------------------------
@@ -341,23 +385,96 @@ int Kernel::CreateFile(char *filename, int initialSize)
 {
     return fileSystem -> Create(filename, initialSize);
 }
+//----------------------------------------------------------------------
+// Kernel::Open/Read/Write/Seek/Close
+// 	File system calls on behalf of the running user program.  An
+//	OpenFileId is an index into the program's own table of open
+//	files (see AddrSpace::AddFile); each open has its own position
+//	in the file, while the file itself is shared system-wide.  The
+//	program's asynchronous transfers are kept out while a call uses
+//	its files (see AddrSpace::LockFiles).
+//	Calls with an id that is not open fail with -1.
+//----------------------------------------------------------------------
+
 OpenFileId Kernel::Open(char *filename)
 {
-    fileSystem -> currentOpenedFile = fileSystem -> Open(filename);
-    if(fileSystem -> currentOpenedFile)
-        return 1;
-    else
+    OpenFile *file = fileSystem -> Open(filename);
+    OpenFileId id;
+
+    if(file == NULL)
         return -1;
+    id = currentThread -> space -> AddFile(file);
+    if(id == -1)
+        delete file;			// too many files open
+    return id;
 }
 int Kernel::Read(char *buffer, int size, OpenFileId id)
 {
-    return fileSystem -> Read(buffer, size, id);
+    AddrSpace *space = currentThread -> space;
+    OpenFile *file = space -> GetFile(id);
+    int result;
+
+    if(file == NULL)
+        return -1;
+    space -> LockFiles();
+    result = file -> Read(buffer, size);
+    space -> UnlockFiles();
+    return result;
 }
 int Kernel::Write(char *buffer, int size, OpenFileId id)
 {
-    return fileSystem -> Write(buffer, size, id);
+    AddrSpace *space = currentThread -> space;
+    OpenFile *file = space -> GetFile(id);
+    int result;
+
+    if(file == NULL)
+        return -1;
+    space -> LockFiles();
+    result = file -> Write(buffer, size);
+    space -> UnlockFiles();
+    return result;
+}
+int Kernel::Seek(int position, OpenFileId id)
+{
+    AddrSpace *space = currentThread -> space;
+    OpenFile *file = space -> GetFile(id);
+
+    if(file == NULL || position < 0)
+        return -1;
+    space -> LockFiles();
+    file -> Seek(position);
+    space -> UnlockFiles();
+    return 1;
 }
 int Kernel::Close(OpenFileId id)
 {
-    return fileSystem -> Close(id);
-}
\ No newline at end of file
+    if(!currentThread -> space -> CloseFile(id))
+        return -1;
+    return 1;
+}
+int Kernel::Remove(char *filename)
+{
+    return fileSystem -> Remove(filename);
+}
+
+//----------------------------------------------------------------------
+// Kernel::AioRead/AioWrite/AioWait
+// 	Asynchronous reads and writes on behalf of the running user
+//	program.  Each one is carried out by a kernel thread of its own
+//	(see AddrSpace::StartAio), so the program keeps running while
+//	that thread waits for the disk.  Fail with -1 for an id that is
+//	not open, or when too many transfers are outstanding.
+//----------------------------------------------------------------------
+
+int Kernel::AioRead(char *buffer, int size, OpenFileId id)
+{
+    return currentThread -> space -> StartAio(id, buffer, size, FALSE);
+}
+int Kernel::AioWrite(char *buffer, int size, OpenFileId id)
+{
+    return currentThread -> space -> StartAio(id, buffer, size, TRUE);
+}
+int Kernel::AioWait(int aio)
+{
+    return currentThread -> space -> WaitAio(aio);
+}
@@ -18,6 +18,7 @@
 #include "alarm.h"
 #include "filesys.h"
 #include "machine.h"
+#include "disk.h"
 
 class PostOfficeInput;
 class PostOfficeOutput;
@@ -53,7 +54,12 @@ class Kernel {
   OpenFileId Open(char *filename);
   int Read(char *buffer, int size, OpenFileId id);
   int Write(char *buffer, int size, OpenFileId id);
+  int Seek(int position, OpenFileId id);
   int Close(OpenFileId id);
+  int Remove(char *filename);
+  int AioRead(char *buffer, int size, OpenFileId id);
+  int AioWrite(char *buffer, int size, OpenFileId id);
+  int AioWait(int aio);
 
 	#ifdef FILESYS_STUB	
 	int CreateFile(char* filename); // fileSystem call
@@ -72,6 +78,9 @@ class Kernel {
     SynchConsoleOutput *synchConsoleOut;
     SynchDisk *synchDisk;
     FileSystem *fileSystem;     
+#ifndef FILESYS_STUB
+    OpenFileTable *openFileTable;	// file headers in use, system-wide
+#endif
     PostOfficeInput *postOfficeIn;
     PostOfficeOutput *postOfficeOut;
 
@@ -90,7 +99,11 @@ class Kernel {
     char *consoleOut;           // file to send console output to
 #ifndef FILESYS_STUB
     bool formatFlag;          // format the disk if this is true
+    int preallocSectors;        // sectors at a time to give growing files
 #endif
+    DiskSchedPolicy diskPolicy; // order in which to serve disk requests
+    bool mapDisk;               // map the DISK file into memory
+    bool printStats;            // print performance statistics at halt
 };
 
 
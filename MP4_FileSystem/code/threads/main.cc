@@ -4,10 +4,10 @@
 //
 // Usage: nachos -d <debugflags> -rs <random seed #>
 //              -s -x <nachos file> -ci <consoleIn> -co <consoleOut>
-//              -f -cp <unix file> <nachos file>
-//              -p <nachos file> -r <nachos file> -l -D
+//              -f -cp <unix file> <nachos file> -cpr <unix dir> <nachos dir>
+//              -p <nachos file> -r <nachos file> -l -D -bench
 //              -n <network reliability> -m <machine id>
-//              -z -K -C -N
+//              -z -K -C -N -ds <disk policy> -dm -st
 //
 //    -d causes certain debugging messages to be printed (see debug.h)
 //    -rs causes Yield to occur at random (but repeatable) spots
@@ -21,14 +21,24 @@
 //    -K run a simple self test of kernel threads and synchronization
 //    -C run an interactive console test
 //    -N run a two-machine network test (see Kernel::NetworkTest)
+//    -ds sets the order disk requests are served in: fcfs (the
+//	default), sstf, scan or clook
+//    -dm maps the simulated disk's UNIX file into memory, instead of
+//	reading and writing it for every request
+//    -st prints performance statistics when Nachos halts
 //
 //    Filesystem-related flags:
 //    -f forces the Nachos disk to be formatted
+//    -pa sets how many sectors at a time a growing file is given
 //    -cp copies a file from UNIX to Nachos
+//    -cpr copies a whole UNIX directory tree into a Nachos directory,
+//	in one run (combine with -f and -dm to build a disk quickly)
 //    -p prints a Nachos file to stdout
 //    -r removes a Nachos file from the file system
 //    -l lists the contents of the Nachos directory
 //    -D prints the contents of the entire file system 
+//    -bench runs the file system benchmark, printing comma-separated
+//	results (use with -f, on a fresh disk)
 //
 //  Note: the file system flags are not used if the stub filesystem
 //        is being used
@@ -44,6 +54,7 @@
 #include "main.h"
 #include "filesys.h"
 #include "openfile.h"
+#include "fsbench.h"
 #include "sysdep.h"
 
 // global variables
@@ -70,11 +81,16 @@ Cleanup(int x)
 //-------------------------------------------------------------------
 static const int TransferSize = 128;
 
+// The longest path, with its '\0', that Copy and CopyTree can take.
+static const int MaxCopyPath = 255;
+
 
 #ifndef FILESYS_STUB
 //----------------------------------------------------------------------
 // Copy
-//      Copy the contents of the UNIX file "from" to the Nachos file "to"
+//      Copy the contents of the UNIX file "from" to the Nachos file "to".
+//	The Nachos file is created at its full length; each sector is
+//	given space as it is first written, near the one before it.
 //----------------------------------------------------------------------
 
 //MP4 modified
@@ -85,7 +101,7 @@ Copy(char *from, char *to)
     OpenFile* openFile;
     int amountRead, fileLength;
     char *buffer;
-    char *tmp = new char[255];
+    char *tmp = new char[MaxCopyPath];
 
 // Open UNIX file
     if ((fd = OpenForReadWrite(from,FALSE)) < 0) {       
@@ -126,6 +142,65 @@ Copy(char *from, char *to)
     Close(fd);
 }
 
+//----------------------------------------------------------------------
+// JoinPath
+//      Put "dir/name" in "path", which holds MaxCopyPath bytes.  "dir"
+//	may be "/".  Return FALSE if it does not fit.
+//----------------------------------------------------------------------
+
+static bool
+JoinPath(char *path, char *dir, char *name)
+{
+    const char *prefix = (strcmp(dir, "/") == 0) ? "" : dir;
+
+    if (strlen(prefix) + strlen(name) + 2 > (unsigned) MaxCopyPath)
+	return FALSE;
+    sprintf(path, "%s/%s", prefix, name);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// CopyTree
+//      Copy the UNIX file or directory "from" to "to" in Nachos,
+//	creating the directory "to" and everything below it.  "to" may
+//	be "/", which already exists.  A whole tree goes in with a single
+//	boot of Nachos, instead of one per file; each file is copied by
+//	Copy.  Paths longer than MaxCopyPath are skipped.
+//----------------------------------------------------------------------
+
+static void
+CopyTree(char *from, char *to)
+{
+    void *dir;
+    char *name;
+    char fromPath[MaxCopyPath], toPath[MaxCopyPath];
+
+    if (strlen(from) >= (unsigned) MaxCopyPath 
+		|| strlen(to) >= (unsigned) MaxCopyPath) {
+	printf("Copy: path too long, skipping %s\n", from);
+	return;
+    }
+    strcpy(toPath, to);			// the file system takes it apart
+    dir = OpenDir(from);
+    if (dir == NULL) {			// a plain file
+	Copy(from, toPath);
+	return;
+    }
+    if (strcmp(to, "/") != 0 && !kernel->fileSystem->CreateDirectory(toPath)) {
+	printf("Copy: couldn't create directory %s\n", to);
+	CloseDir(dir);
+	return;
+    }
+    while ((name = NextDirEntry(dir)) != NULL) {
+	if (!JoinPath(fromPath, from, name) || !JoinPath(toPath, to, name)) {
+	    printf("Copy: path too long, skipping %s/%s\n", from, name);
+	    continue;
+	}
+	CopyTree(fromPath, toPath);
+    }
+    CloseDir(dir);
+}
+
 #endif // FILESYS_STUB
 
 //----------------------------------------------------------------------
@@ -199,10 +274,13 @@ main(int argc, char **argv)
 #ifndef FILESYS_STUB
     char *copyUnixFileName = NULL;    // UNIX file to be copied into Nachos
     char *copyNachosFileName = NULL;  // name of copied file in Nachos
+    char *copyUnixTreeName = NULL;    // UNIX tree to be copied into Nachos
+    char *copyNachosTreeName = NULL;  // where it goes in Nachos
     char *printFileName = NULL; 
     char *removeFileName = NULL;
     bool dirListFlag = false;
     bool dumpFlag = false;
+    bool benchFlag = false;
 	// MP4 mod tag
 	char *createDirectoryName = NULL;
 	char *listDirectoryName = NULL;
@@ -244,6 +322,12 @@ main(int argc, char **argv)
 	    copyNachosFileName = argv[i + 2];
 	    i += 2;
 	}
+	else if (strcmp(argv[i], "-cpr") == 0) {
+	    ASSERT(i + 2 < argc);
+	    copyUnixTreeName = argv[i + 1];
+	    copyNachosTreeName = argv[i + 2];
+	    i += 2;
+	}
 	else if (strcmp(argv[i], "-p") == 0) {
 	    ASSERT(i + 1 < argc);
 	    printFileName = argv[i + 1];
@@ -284,6 +368,9 @@ main(int argc, char **argv)
 		mkdirFlag = true;
 		i++;
 	}
+	else if (strcmp(argv[i], "-bench") == 0) {
+	    benchFlag = true;
+	}
 	else if (strcmp(argv[i], "-D") == 0) {
 	    dumpFlag = true;
 	}
@@ -294,8 +381,10 @@ main(int argc, char **argv)
 	    cout << "Partial usage: nachos [-K] [-C] [-N]\n";
 #ifndef FILESYS_STUB
             cout << "Partial usage: nachos [-cp UnixFile NachosFile]\n";
+            cout << "Partial usage: nachos [-cpr UnixDir NachosDir]\n";
             cout << "Partial usage: nachos [-p fileName] [-r fileName]\n";
             cout << "Partial usage: nachos [-l] [-D]\n";
+            cout << "Partial usage: nachos [-f -bench]\n";
 #endif //FILESYS_STUB
 	}
 
@@ -330,6 +419,9 @@ main(int argc, char **argv)
     if (copyUnixFileName != NULL && copyNachosFileName != NULL) {
 		Copy(copyUnixFileName,copyNachosFileName);
     }
+    if (copyUnixTreeName != NULL && copyNachosTreeName != NULL) {
+		CopyTree(copyUnixTreeName, copyNachosTreeName);
+    }
     if (dumpFlag) {
 		kernel->fileSystem->Print();
     }
@@ -346,6 +438,9 @@ main(int argc, char **argv)
     if (printFileName != NULL) {
       Print(printFileName);
     }
+    if (benchFlag) {
+		FileSystemBench();
+    }
 #endif // FILESYS_STUB
 
     // finally, run an initial user program if requested to do so
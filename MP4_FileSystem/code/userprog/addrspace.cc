@@ -19,6 +19,7 @@
 #include "main.h"
 #include "addrspace.h"
 #include "machine.h"
+#include "synch.h"
 #include "noff.h"
 
 //----------------------------------------------------------------------
@@ -67,6 +68,8 @@ SwapHeader (NoffHeader *noffH)
 
 AddrSpace::AddrSpace()
 {
+    static char fileLockName[] = "open files";
+
     pageTable = new TranslationEntry[NumPhysPages];
     for (int i = 0; i < NumPhysPages; i++) {
 	pageTable[i].virtualPage = i;	// for now, virt page # = phys page #
@@ -79,18 +82,211 @@ AddrSpace::AddrSpace()
     
     // zero out the entire address space
     bzero(kernel->machine->mainMemory, MemorySize);
+
+    for (int i = 0; i < MaxOpenFiles; i++)
+	fileTable[i] = NULL;
+    for (int i = 0; i < MaxAioRequests; i++)
+	aioTable[i] = NULL;
+    fileLock = new Lock(fileLockName);
 }
 
 //----------------------------------------------------------------------
 // AddrSpace::~AddrSpace
-// 	Dealloate an address space.
+// 	Dealloate an address space, closing any files the program
+//	left open, once the transfers it never waited for are done.
 //----------------------------------------------------------------------
 
 AddrSpace::~AddrSpace()
 {
+   for (int i = 0; i < MaxAioRequests; i++)
+	if (aioTable[i] != NULL)
+	    WaitAio(i);
+   for (int i = 0; i < MaxOpenFiles; i++)
+	delete fileTable[i];
+   delete fileLock;
    delete pageTable;
 }
 
+//----------------------------------------------------------------------
+// AddrSpace::AddFile
+// 	Enter an open file in this program's table of open files, and
+//	return the id the program will use for it -- the lowest free
+//	one, as in UNIX.  Ids 0 and 1 stand for the console, and are
+//	never handed out.  Return -1 if the program has too many files
+//	open already.
+//----------------------------------------------------------------------
+
+OpenFileId
+AddrSpace::AddFile(OpenFile *file)
+{
+    for (int i = 2; i < MaxOpenFiles; i++) {
+	if (fileTable[i] == NULL) {
+	    fileTable[i] = file;
+	    return i;
+	}
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::GetFile
+// 	Return the open file with id "id", or NULL if the id is not in
+//	use (or not a legal id at all).
+//----------------------------------------------------------------------
+
+OpenFile *
+AddrSpace::GetFile(OpenFileId id)
+{
+    if (id < 0 || id >= MaxOpenFiles)
+	return NULL;
+    return fileTable[id];
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::CloseFile
+// 	Close the open file with id "id", and make the id free for
+//	reuse.  Return FALSE if there was no such file.  Transfers still
+//	going on with the file are finished first; their results are
+//	lost.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::CloseFile(OpenFileId id)
+{
+    OpenFile *file = GetFile(id);
+
+    if (file == NULL)
+	return FALSE;
+    for (int i = 0; i < MaxAioRequests; i++)
+	if (aioTable[i] != NULL && aioTable[i]->file == file)
+	    WaitAio(i);
+    LockFiles();			// other transfers may share its header
+    delete file;
+    UnlockFiles();
+    fileTable[id] = NULL;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::LockFiles/UnlockFiles
+// 	Bracket every use of this program's open files, by its own thread
+//	in a file system call or by a kernel thread carrying out one of
+//	its transfers.  An OpenFile, and the header it shares with other
+//	OpenFiles of the file, may only be used by one thread at a time,
+//	and these threads block in the middle of using them -- waiting
+//	for the disk, or for the journal -- so without the lock, two
+//	transfers on the same file could interleave.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::LockFiles()
+{
+    fileLock->Acquire();
+}
+
+void
+AddrSpace::UnlockFiles()
+{
+    fileLock->Release();
+}
+
+//----------------------------------------------------------------------
+// AioTransfer
+// 	The body of the kernel thread carrying out an asynchronous read
+//	or write.  It blocks in the SynchDisk like any other reader or
+//	writer, and is woken through the disk interrupt; meanwhile the
+//	program that started it keeps the CPU.  Transfers of the same
+//	program take turns with each other, and with the program's own
+//	file system calls, through its file lock.
+//----------------------------------------------------------------------
+
+static void
+AioTransfer(AioRequest *request)
+{
+    request->lock->Acquire();
+    if (request->writing)
+	request->result = request->file->WriteAt(request->buffer, 
+				request->size, request->position);
+    else
+	request->result = request->file->ReadAt(request->buffer, 
+				request->size, request->position);
+    request->lock->Release();
+    request->done->V();
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::StartAio
+// 	Start reading or writing "size" bytes between "buffer" and the
+//	open file with id "id", at the file's seek position, and move
+//	the seek position past them right away, so that a program can
+//	queue several transfers in a row.  The transfer itself is left
+//	to a new kernel thread.  Return an id for AioWait, or -1 if the
+//	file is not open or too many transfers are outstanding.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::StartAio(OpenFileId id, char *buffer, int size, bool writing)
+{
+    static char doneName[] = "aio done";
+    static char threadName[] = "aio";
+    OpenFile *file = GetFile(id);
+    AioRequest *request;
+    Thread *thread;
+    int aio;
+
+    if (file == NULL || size < 0)
+	return -1;
+    for (aio = 0; aio < MaxAioRequests; aio++)
+	if (aioTable[aio] == NULL)
+	    break;
+    if (aio == MaxAioRequests)
+	return -1;			// too many outstanding
+
+    request = new AioRequest;
+    request->file = file;
+    request->buffer = buffer;
+    request->size = size;
+    request->position = file->Tell();
+    request->writing = writing;
+    request->result = 0;
+    request->done = new Semaphore(doneName, 0);
+    request->lock = fileLock;
+    aioTable[aio] = request;
+    LockFiles();			// Seek writes out gathered Writes
+    file->Seek(request->position + size);
+    UnlockFiles();
+
+    DEBUG(dbgFile, "Starting aio " << aio << ": " << size << " bytes at " << request->position);
+    thread = new Thread(threadName, kernel->currentThread->getID());
+					// works on behalf of the caller
+    thread->Fork((VoidFunctionPtr) AioTransfer, (void *) request);
+    return aio;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::WaitAio
+// 	Wait for the transfer with id "aio" to finish, free its id, and
+//	return the number of bytes it transferred; -1 if there is no
+//	such transfer.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::WaitAio(int aio)
+{
+    AioRequest *request;
+    int result;
+
+    if (aio < 0 || aio >= MaxAioRequests || aioTable[aio] == NULL)
+	return -1;
+    request = aioTable[aio];
+    aioTable[aio] = NULL;
+    request->done->P();
+    result = request->result;
+    delete request->done;
+    delete request;
+    return result;
+}
+
 
 //----------------------------------------------------------------------
 // AddrSpace::Load
@@ -17,6 +17,30 @@
 #include "filesys.h"
 
 #define UserStackSize		1024 	// increase this as necessary!
+#define MaxOpenFiles		20	// open files per address space;
+					// ids 0 and 1 are the console
+#define MaxAioRequests		8	// transfers outstanding at once
+
+class Lock;
+class Semaphore;
+
+// The following class defines one asynchronous read or write started
+// by a user program: which part of which file, where the data goes
+// or comes from, and, once "done" is signalled, how many bytes were
+// transferred.
+
+class AioRequest {
+  public:
+    OpenFile *file;			// the file, at an id of the program
+    char *buffer;			// in the program's memory
+    int size;				// bytes requested
+    int position;			// where in the file
+    bool writing;			// write, rather than read?
+    int result;				// bytes actually transferred
+    Semaphore *done;			// signalled when it is finished
+    Lock *lock;				// the program's file lock (see
+					// AddrSpace::LockFiles)
+};
 
 class AddrSpace {
   public:
@@ -39,12 +63,32 @@ class AddrSpace {
     // is 0 for Read, 1 for Write.
     ExceptionType Translate(unsigned int vaddr, unsigned int *paddr, int mode);
 
+    OpenFileId AddFile(OpenFile *file);	// Give an open file an id, or
+					// return -1 if the table is full
+    OpenFile *GetFile(OpenFileId id);	// The open file with this id, or
+					// NULL if there is none
+    bool CloseFile(OpenFileId id);	// Close it and free the id
+    void LockFiles();			// Wait until no one else is using
+    void UnlockFiles();			// this program's open files, and
+					// keep them to ourselves until
+					// UnlockFiles
+
+    int StartAio(OpenFileId id, char *buffer, int size, bool writing);
+					// Start a transfer on a kernel
+					// thread; return its id, or -1
+    int WaitAio(int aio);		// Wait for it; return the result
+
   private:
     TranslationEntry *pageTable;	// Assume linear page table translation
 					// for now!
     unsigned int numPages;		// Number of pages in the virtual 
 					// address space
 
+    OpenFile *fileTable[MaxOpenFiles];	// This program's open files, by id
+    AioRequest *aioTable[MaxAioRequests]; // Transfers not yet waited for
+    Lock *fileLock;			// Held by whoever is using an open
+					// file of this program
+
     void InitRegisters();		// Initialize user-level CPU registers,
 					// before jumping to user code
 
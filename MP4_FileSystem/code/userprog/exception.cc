@@ -152,6 +152,74 @@ ExceptionHandler(ExceptionType which)
 			return;
 			ASSERTNOTREACHED();
 			break;
+		case SC_Seek:
+			{
+				val = kernel -> machine -> ReadRegister(4);
+				file_id = kernel -> machine -> ReadRegister(5);
+				status = SysSeek(val, (OpenFileId)file_id);
+				kernel -> machine -> WriteRegister(2, (int)status);
+			}
+			kernel -> machine -> WriteRegister(PrevPCReg, kernel -> machine -> ReadRegister(PCReg));
+			kernel -> machine -> WriteRegister(PCReg, kernel -> machine -> ReadRegister(PCReg) + 4);
+			kernel -> machine -> WriteRegister(NextPCReg, kernel -> machine ->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_AioRead:
+			val = kernel -> machine -> ReadRegister(4);
+			{
+				buffer = &(kernel -> machine -> mainMemory[val]);
+				char_num = kernel -> machine -> ReadRegister(5);
+				file_id = (int)kernel -> machine -> ReadRegister(6);
+				status = SysAioRead(buffer, char_num, (OpenFileId)file_id);
+				kernel -> machine -> WriteRegister(2, (int)status);
+			}
+			kernel -> machine -> WriteRegister(PrevPCReg, kernel -> machine -> ReadRegister(PCReg));
+			kernel -> machine -> WriteRegister(PCReg, kernel -> machine -> ReadRegister(PCReg) + 4);
+			kernel -> machine -> WriteRegister(NextPCReg, kernel -> machine ->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_AioWrite:
+			val = kernel -> machine -> ReadRegister(4);
+			{
+				buffer = &(kernel -> machine -> mainMemory[val]);
+				char_num = kernel -> machine -> ReadRegister(5);
+				file_id = (int)kernel -> machine -> ReadRegister(6);
+				status = SysAioWrite(buffer, char_num, (OpenFileId)file_id);
+				kernel -> machine -> WriteRegister(2, (int)status);
+			}
+			kernel -> machine -> WriteRegister(PrevPCReg, kernel -> machine -> ReadRegister(PCReg));
+			kernel -> machine -> WriteRegister(PCReg, kernel -> machine -> ReadRegister(PCReg) + 4);
+			kernel -> machine -> WriteRegister(NextPCReg, kernel -> machine ->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_AioWait:
+			{
+				val = kernel -> machine -> ReadRegister(4);
+				status = SysAioWait(val);
+				kernel -> machine -> WriteRegister(2, (int)status);
+			}
+			kernel -> machine -> WriteRegister(PrevPCReg, kernel -> machine -> ReadRegister(PCReg));
+			kernel -> machine -> WriteRegister(PCReg, kernel -> machine -> ReadRegister(PCReg) + 4);
+			kernel -> machine -> WriteRegister(NextPCReg, kernel -> machine ->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_Remove:
+			val = kernel -> machine -> ReadRegister(4);
+			{
+				char *filename = &(kernel -> machine -> mainMemory[val]);
+				status = SysRemove(filename);
+				kernel -> machine -> WriteRegister(2, (int)status);
+			}
+			kernel -> machine -> WriteRegister(PrevPCReg, kernel -> machine -> ReadRegister(PCReg));
+			kernel -> machine -> WriteRegister(PCReg, kernel -> machine -> ReadRegister(PCReg) + 4);
+			kernel -> machine -> WriteRegister(NextPCReg, kernel -> machine ->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
 		case SC_Close:
 			{
 				file_id = kernel -> machine -> ReadRegister(4);
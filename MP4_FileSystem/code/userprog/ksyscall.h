@@ -43,10 +43,30 @@ int SysWrite(char *buffer, int size, OpenFileId id)
 {
 	return kernel -> interrupt -> Write(buffer, size, id);
 }
+int SysSeek(int position, OpenFileId id)
+{
+	return kernel -> interrupt -> Seek(position, id);
+}
 int SysClose(OpenFileId id)
 {
 	return kernel -> interrupt -> Close(id);
 }
+int SysRemove(char *filename)
+{
+	return kernel -> interrupt -> Remove(filename);
+}
+int SysAioRead(char *buffer, int size, OpenFileId id)
+{
+	return kernel -> interrupt -> AioRead(buffer, size, id);
+}
+int SysAioWrite(char *buffer, int size, OpenFileId id)
+{
+	return kernel -> interrupt -> AioWrite(buffer, size, id);
+}
+int SysAioWait(int aio)
+{
+	return kernel -> interrupt -> AioWait(aio);
+}
 
 #ifdef FILESYS_STUB
 int SysCreate(char *filename)
@@ -34,6 +34,9 @@
 #define SC_ExecV	13
 #define SC_ThreadExit   14
 #define SC_ThreadJoin   15
+#define SC_AioRead      16
+#define SC_AioWrite     17
+#define SC_AioWait      18
 #define SC_Add		42
 #define SC_MSG		100
 
@@ -148,6 +151,23 @@ int Seek(int position, OpenFileId id);
  */
 int Close(OpenFileId id);
 
+/* A unique identifier for an asynchronous read or write in progress. */
+typedef int AioId;
+
+/* Start reading/writing "size" bytes between "buffer" and the open file,
+ * at its current seek position, which moves past them at once; return
+ * without waiting for the transfer.  The buffer must be left alone
+ * until AioWait says the transfer is done.
+ * Return an AioId, or a negative error code on failure.
+ */
+AioId AioRead(char *buffer, int size, OpenFileId id);
+AioId AioWrite(char *buffer, int size, OpenFileId id);
+
+/* Wait for the transfer "aio" to finish, and return the number of bytes
+ * actually read or written, as Read and Write would have.
+ */
+int AioWait(AioId aio);
+
 
 /* User-level thread operations: Fork and Yield.  To allow multiple
  * threads to run within a user program. 